@@ -23,7 +23,23 @@ enum vial_aes_error {
 	VIAL_AES_ERROR_LENGTH, /**< Input of invalid length */
 	VIAL_AES_ERROR_IV, /**< IV missing when required or does not meet requirements */
 	VIAL_AES_ERROR_MAC, /**< Message authentication failed */
-	VIAL_AES_ERROR_CIPHER /**< Operation not valid for selected cipher mode */
+	VIAL_AES_ERROR_CIPHER, /**< Operation not valid for selected cipher mode */
+	VIAL_AES_ERROR_BACKEND, /**< Backend not supported by the CPU or the build */
+	VIAL_AES_ERROR_THREADS /**< Threads could not be created or are not supported by the build */
+};
+
+/**
+ * Implementation of the block cipher used by an expanded key
+ */
+enum vial_aes_backend {
+	VIAL_AES_BACKEND_AUTO, /**< Fastest backend supported by the CPU */
+	VIAL_AES_BACKEND_PORTABLE, /**< Portable C implementation */
+	VIAL_AES_BACKEND_AESNI, /**< x86 AES-NI instructions */
+	VIAL_AES_BACKEND_BITSLICE, /**< Constant-time bitsliced C implementation, processes 8 blocks at once */
+	VIAL_AES_BACKEND_VPAES, /**< Constant-time x86 SSSE3 vector permute implementation, fast on single blocks */
+	VIAL_AES_BACKEND_VAES, /**< x86 VAES and VPCLMULQDQ on 256-bit vectors, for CTR and GCM throughput */
+	VIAL_AES_BACKEND_ARMV8, /**< AArch64 AES and PMULL instructions */
+	VIAL_AES_BACKEND_TTABLE /**< Fast lookup tables, not constant time, only built with `VIAL_AES_TTABLE` */
 };
 
 /**
@@ -46,20 +62,38 @@ struct vial_aes_block {
 	uint32_t words[VIAL_AES_BLOCK_SIZE / 4];
 };
 
+struct vial_aes_impl;
+
 /**
- * Represents an expanded AES key
+ * Represents an expanded AES key.
+ * The layout of the expansion depends on the backend.
  */
 struct vial_aes_key {
 	struct vial_aes_block key_exp[15];
+	struct vial_aes_block key_dec[15]; /**< Equivalent inverse cipher schedule, for backends which use one */
+	uint64_t key_bitsliced[120]; /**< Round keys of the bitsliced backend, eight words each */
 	unsigned rounds;
+	const struct vial_aes_impl *impl;
 };
 
 /**
- * Initialises a key structure.
+ * Initialises a key structure using the fastest backend supported by the CPU.
  * Accepted key lengths are 128, 192, 256 bits.
  */
 enum vial_aes_error vial_aes_key_init(struct vial_aes_key *self, unsigned keybits, const uint8_t *key);
 
+/**
+ * Initialises a key structure using the given backend.
+ * Fails with `VIAL_AES_ERROR_BACKEND` if the backend is not supported.
+ */
+enum vial_aes_error vial_aes_key_init_backend(struct vial_aes_key *self, enum vial_aes_backend backend,
+	unsigned keybits, const uint8_t *key);
+
+/**
+ * Returns the backend used by an expanded key
+ */
+enum vial_aes_backend vial_aes_key_backend(const struct vial_aes_key *self);
+
 /**
  * Encrypts a single AES block.
  * Should not be called directly unless as part of a more elaborate scheme.
@@ -72,6 +106,19 @@ void vial_aes_block_encrypt(const struct vial_aes_key *key, uint8_t *dst, const
  */
 void vial_aes_block_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src);
 
+/**
+ * Encrypts `nblocks` independent AES blocks, `dst` may equal `src`.
+ * Backends process several blocks at once, so this is faster than repeated single block calls.
+ * Should not be called directly unless as part of a more elaborate scheme.
+ */
+void vial_aes_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+
+/**
+ * Decrypts `nblocks` independent AES blocks, `dst` may equal `src`.
+ * Should not be called directly unless as part of a more elaborate scheme.
+ */
+void vial_aes_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+
 /**
  * Stores the state/context for computing a CMAC (OMAC1) tag
  */
@@ -107,6 +154,27 @@ void vial_aes_cmac_final(struct vial_aes_cmac *self, uint8_t *tag, size_t tag_le
  */
 void vial_aes_cmac_tag(const struct vial_aes_key *key, uint8_t *tag, size_t tag_len, const uint8_t *src, size_t len);
 
+/** Number of independent messages processed in lockstep by the multi-buffer functions */
+#define VIAL_AES_LANES 8
+
+/**
+ * Independent message for the multi-buffer functions.
+ * Each lane processes one message a block at a time and takes the next job when it finishes.
+ */
+struct vial_aes_job {
+	const struct vial_aes_key *key;
+	const uint8_t *src;
+	size_t len;
+	uint8_t *dst; /**< Ciphertext of `len` bytes in CBC mode, or the tag of CMAC */
+	const uint8_t *iv; /**< Initialisation vector of 16 bytes in CBC mode */
+	size_t tag_len; /**< Length of the CMAC tag */
+};
+
+/**
+ * Computes the CMAC tags of `count` independent messages
+ */
+void vial_aes_cmac_jobs(struct vial_aes_job *jobs, size_t count);
+
 struct vial_aes_vtable;
 
 struct vial_aes_base {
@@ -192,6 +260,12 @@ enum vial_aes_error vial_aes_cbc_encrypt(struct vial_aes_cbc *self, uint8_t *dst
  */
 enum vial_aes_error vial_aes_cbc_decrypt(struct vial_aes_cbc *self, uint8_t *dst, const uint8_t *src, size_t len);
 
+/**
+ * Encrypts `count` independent messages in CBC mode, each in one piece.
+ * All lengths must be multiples of 16 bytes, otherwise nothing is encrypted.
+ */
+enum vial_aes_error vial_aes_cbc_encrypt_jobs(struct vial_aes_job *jobs, size_t count);
+
 /**
  * Context for counter (CTR) mode
  */
@@ -200,6 +274,8 @@ struct vial_aes_ctr {
 	const struct vial_aes_key *key;
 	struct vial_aes_block counter, pad;
 	unsigned pad_used;
+	unsigned counter_bits; /**< Number of low bits of the counter which are incremented */
+	struct vial_aes_block start; /**< Counter of the first block, for seeking */
 };
 
 /**
@@ -217,11 +293,30 @@ enum vial_aes_error vial_aes_ctr_init_key(struct vial_aes_ctr *self, const struc
  */
 enum vial_aes_error vial_aes_ctr_reset(struct vial_aes_ctr *self, const uint8_t *iv, size_t len);
 
+/**
+ * Sets the number of low bits of the counter block which are incremented: 32, 64 or 128 (the default).
+ * The counter wraps around within these bits. Call after initialisation with a key, the width is kept on reset.
+ */
+enum vial_aes_error vial_aes_ctr_set_counter_bits(struct vial_aes_ctr *self, unsigned bits);
+
 /**
  * Encrypts or decrypts (part of) a message in CTR mode
  */
 enum vial_aes_error vial_aes_ctr_crypt(struct vial_aes_ctr *self, uint8_t *dst, const uint8_t *src, size_t len);
 
+/**
+ * Moves to the given byte offset of the message, so that the next call to `vial_aes_ctr_crypt()` processes
+ * the data starting there. At most one block is encrypted.
+ */
+enum vial_aes_error vial_aes_ctr_seek(struct vial_aes_ctr *self, uint64_t offset);
+
+/**
+ * Encrypts or decrypts the part of a message starting at byte `offset`, without a context.
+ * The IV is as in `vial_aes_ctr_reset()` and the whole 128-bit counter is incremented.
+ */
+enum vial_aes_error vial_aes_ctr_crypt_at(const struct vial_aes_key *key, const uint8_t *iv, size_t iv_len,
+	uint64_t offset, uint8_t *dst, const uint8_t *src, size_t len);
+
 /**
  * Context for EAX mode
  */
@@ -230,6 +325,8 @@ struct vial_aes_eax {
 	struct vial_aes_ctr ctr;
 	struct vial_aes_cmac cmac;
 	struct vial_aes_block auth;
+	struct vial_aes_block tweak[3]; /**< Encryptions of the first OMAC block of the nonce, header and message */
+	struct vial_aes_block empty_auth; /**< OMAC of an empty header */
 	int auth_done;
 };
 
@@ -280,15 +377,93 @@ enum vial_aes_error vial_aes_eax_get_tag(struct vial_aes_eax *self, uint8_t *tag
  */
 enum vial_aes_error vial_aes_eax_check_tag(struct vial_aes_eax *self, const uint8_t *tag);
 
+/**
+ * Expanded AES key together with the OMAC subkey and the cached blocks of EAX derived from it.
+ * It is only read by the contexts using it, so it can be shared between threads.
+ */
+struct vial_aes_eax_key {
+	struct vial_aes_key key;
+	struct vial_aes_block k1;
+	struct vial_aes_block tweak[3];
+	struct vial_aes_block empty_auth;
+};
+
+/**
+ * Initialises an EAX key using the fastest backend supported by the CPU.
+ * Accepted key lengths are 128, 192, 256 bits.
+ */
+enum vial_aes_error vial_aes_eax_key_init(struct vial_aes_eax_key *self, unsigned keybits, const uint8_t *key);
+
+/**
+ * Initialises an EAX key using the given backend.
+ * Fails with `VIAL_AES_ERROR_BACKEND` if the backend is not supported.
+ */
+enum vial_aes_error vial_aes_eax_key_init_backend(struct vial_aes_eax_key *self, enum vial_aes_backend backend,
+	unsigned keybits, const uint8_t *key);
+
+/**
+ * Initialises the EAX context with a shared EAX key, which must outlive it.
+ * No block is encrypted, unlike `vial_aes_eax_init_key()`.
+ */
+enum vial_aes_error vial_aes_eax_init_eax_key(struct vial_aes_eax *self, const struct vial_aes_eax_key *key);
+
+/**
+ * Encrypts a whole message in EAX mode and authenticates it together with the associated data.
+ * `dst` receives the ciphertext followed by the 16 byte tag, so it must hold `len + 16` bytes.
+ * The header and the message are processed in one pass by backends which support it.
+ */
+enum vial_aes_error vial_aes_eax_seal(const struct vial_aes_eax_key *key, const uint8_t *nonce, size_t nonce_len,
+	const uint8_t *ad, size_t ad_len, uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decrypts a whole message sealed by `vial_aes_eax_seal()`, `len` includes the tag.
+ * `dst` receives `len - 16` bytes, which are zeroed if the tag does not match (`VIAL_AES_ERROR_MAC`),
+ * so that no unauthenticated plaintext is released.
+ */
+enum vial_aes_error vial_aes_eax_open(const struct vial_aes_eax_key *key, const uint8_t *nonce, size_t nonce_len,
+	const uint8_t *ad, size_t ad_len, uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * GHASH key of GCM
+ */
+struct vial_aes_gcm_hash {
+	struct vial_aes_block hash_key;
+	struct vial_aes_block hash_pow[8]; /**< Powers of the hash key, in the format of the backend */
+};
+
+/**
+ * Expanded AES key together with the GHASH key derived from it.
+ * It is only read by the contexts using it, so it can be shared between threads.
+ */
+struct vial_aes_gcm_key {
+	struct vial_aes_key key;
+	struct vial_aes_gcm_hash hash;
+};
+
+/**
+ * Initialises a GCM key using the fastest backend supported by the CPU.
+ * Accepted key lengths are 128, 192, 256 bits.
+ */
+enum vial_aes_error vial_aes_gcm_key_init(struct vial_aes_gcm_key *self, unsigned keybits, const uint8_t *key);
+
+/**
+ * Initialises a GCM key using the given backend.
+ * Fails with `VIAL_AES_ERROR_BACKEND` if the backend is not supported.
+ */
+enum vial_aes_error vial_aes_gcm_key_init_backend(struct vial_aes_gcm_key *self, enum vial_aes_backend backend,
+	unsigned keybits, const uint8_t *key);
+
 /**
  * Context for Galois/Counter Mode (GCM)
  */
 struct vial_aes_gcm {
 	struct vial_aes_base base;
 	struct vial_aes_ctr ctr;
-	struct vial_aes_block auth, hash_key, hash_acc;
+	const struct vial_aes_gcm_hash *hash; /**< That of a shared GCM key, or NULL for `own_hash` */
+	struct vial_aes_block auth, hash_acc;
 	uint64_t a_len, c_len;
 	unsigned buf_len;
+	struct vial_aes_gcm_hash own_hash; /**< Only used when initialised with an AES key */
 };
 
 /**
@@ -301,6 +476,12 @@ enum vial_aes_error vial_aes_gcm_init(struct vial_aes_gcm *self);
  */
 enum vial_aes_error vial_aes_gcm_init_key(struct vial_aes_gcm *self, const struct vial_aes_key *key);
 
+/**
+ * Initialises the GCM context with a shared GCM key, which must outlive it.
+ * No block is encrypted and nothing is precomputed, unlike `vial_aes_gcm_init_key()`.
+ */
+enum vial_aes_error vial_aes_gcm_init_gcm_key(struct vial_aes_gcm *self, const struct vial_aes_gcm_key *key);
+
 /**
  * Resets the GCM context with a unique 12 byte nonce
  */
@@ -338,6 +519,209 @@ enum vial_aes_error vial_aes_gcm_get_tag(struct vial_aes_gcm *self, uint8_t *tag
  */
 enum vial_aes_error vial_aes_gcm_check_tag(struct vial_aes_gcm *self, const uint8_t *tag);
 
+/**
+ * Encrypts a whole message in GCM and authenticates it together with the associated data.
+ * The nonce must be 12 bytes long. `dst` receives the ciphertext followed by the 16 byte tag,
+ * so it must hold `len + 16` bytes.
+ */
+enum vial_aes_error vial_aes_gcm_seal(const struct vial_aes_gcm_key *key, const uint8_t *nonce, size_t nonce_len,
+	const uint8_t *ad, size_t ad_len, uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decrypts a whole message sealed by `vial_aes_gcm_seal()`, `len` includes the tag.
+ * `dst` receives `len - 16` bytes, which are zeroed if the tag does not match (`VIAL_AES_ERROR_MAC`),
+ * so that no unauthenticated plaintext is released.
+ */
+enum vial_aes_error vial_aes_gcm_open(const struct vial_aes_gcm_key *key, const uint8_t *nonce, size_t nonce_len,
+	const uint8_t *ad, size_t ad_len, uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Packet for the batch AEAD functions, which encrypt or decrypt many messages in one call.
+ * Only the key of the mode of the function is used.
+ */
+struct vial_aes_aead_job {
+	const struct vial_aes_gcm_key *gcm_key; /**< Key in GCM */
+	const struct vial_aes_eax_key *eax_key; /**< Key in EAX */
+	const uint8_t *nonce;
+	size_t nonce_len;
+	const uint8_t *ad; /**< Associated data, authenticated but not encrypted */
+	size_t ad_len;
+	const uint8_t *src;
+	uint8_t *dst; /**< Output of `len` bytes, zeroed if a decrypted packet fails authentication */
+	size_t len;
+	uint8_t *tag; /**< Tag of 16 bytes, written when encrypting and checked when decrypting */
+	enum vial_aes_error status; /**< Result for this packet, set by the batch functions */
+};
+
+/**
+ * Encrypts `count` independent packets in GCM, each as by `vial_aes_gcm_seal()` but with a separate tag.
+ * Returns the status of the first packet which failed, if any.
+ */
+enum vial_aes_error vial_aes_gcm_encrypt_jobs(struct vial_aes_aead_job *jobs, size_t count);
+
+/**
+ * Decrypts `count` independent packets in GCM. A packet whose tag does not match has its output zeroed
+ * and the status `VIAL_AES_ERROR_MAC`, without affecting the others.
+ * Returns the status of the first packet which failed, if any.
+ */
+enum vial_aes_error vial_aes_gcm_decrypt_jobs(struct vial_aes_aead_job *jobs, size_t count);
+
+/**
+ * Encrypts `count` independent packets in EAX mode, each as by `vial_aes_eax_seal()` but with a separate tag.
+ * Returns the status of the first packet which failed, if any.
+ */
+enum vial_aes_error vial_aes_eax_encrypt_jobs(struct vial_aes_aead_job *jobs, size_t count);
+
+/**
+ * Decrypts `count` independent packets in EAX mode. A packet whose tag does not match has its output zeroed
+ * and the status `VIAL_AES_ERROR_MAC`, without affecting the others.
+ * Returns the status of the first packet which failed, if any.
+ */
+enum vial_aes_error vial_aes_eax_decrypt_jobs(struct vial_aes_aead_job *jobs, size_t count);
+
+/**
+ * Pool of threads which process large messages in parallel
+ */
+struct vial_aes_pool;
+
+/**
+ * Creates a pool of `nthreads` threads, including the thread calling the parallel functions,
+ * or one per CPU if 0. Fails with `VIAL_AES_ERROR_THREADS` if the threads cannot be created.
+ */
+enum vial_aes_error vial_aes_pool_create(struct vial_aes_pool **pool, unsigned nthreads);
+
+/**
+ * Stops the threads and frees the pool
+ */
+void vial_aes_pool_destroy(struct vial_aes_pool *pool);
+
+/**
+ * Encrypts or decrypts (part of) a message in CTR mode, splitting it between the threads of the pool.
+ * The output and the resulting context are the same as with `vial_aes_ctr_crypt()`.
+ * With a NULL pool the calling thread does all the work.
+ */
+enum vial_aes_error vial_aes_ctr_crypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ctr *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Encrypts (part of) a message in ECB mode, splitting it between the threads of the pool.
+ * The length must be a multiple of 16 bytes.
+ */
+enum vial_aes_error vial_aes_ecb_encrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ecb *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decrypts (part of) a message in ECB mode, splitting it between the threads of the pool.
+ * The length must be a multiple of 16 bytes.
+ */
+enum vial_aes_error vial_aes_ecb_decrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ecb *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decrypts (part of) a message in CBC mode, splitting it between the threads of the pool.
+ * The length must be a multiple of 16 bytes. The output and the resulting context are the same
+ * as with `vial_aes_cbc_decrypt()`.
+ */
+enum vial_aes_error vial_aes_cbc_decrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_cbc *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Encrypts (part of) a message in GCM, splitting it between the threads of the pool.
+ * Each thread hashes its own chunks, which are then combined, so the tag is the same as with `vial_aes_gcm_encrypt()`.
+ */
+enum vial_aes_error vial_aes_gcm_encrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_gcm *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Decrypts (part of) a message in GCM, splitting it between the threads of the pool
+ */
+enum vial_aes_error vial_aes_gcm_decrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_gcm *self,
+	uint8_t *dst, const uint8_t *src, size_t len);
+
+/** Size of the header at the start of a chunked stream */
+#define VIAL_AES_STREAM_HEADER_SIZE 32
+
+/** Size of the random salt of a chunked stream, from which the key of the stream is derived */
+#define VIAL_AES_STREAM_SALT_SIZE 24
+
+/** Smallest and largest chunks of a stream, as powers of two */
+#define VIAL_AES_STREAM_MIN_BITS 4
+#define VIAL_AES_STREAM_MAX_BITS 30
+
+/**
+ * Chunked stream of a message sealed with GCM or EAX (the STREAM construction), which a reader can verify
+ * and use a chunk at a time, starting from any chunk.
+ *
+ * The stream is a header of 32 bytes followed by the chunks of the message, each sealed with its own tag.
+ * All chunks are `chunk_size` bytes except the last, which may be shorter or empty, so chunk `i` starts at
+ * `vial_aes_stream_chunk_offset(i)` in the stream and at `i * chunk_size` in the message.
+ * The chunks are sealed with a key of their own, derived from the master key and the header, which holds
+ * a random salt, with the counter mode KDF of NIST SP 800-108 and CMAC: block `i` of the key is
+ * `CMAC(master key, i || "VIAL stream key" || 0 || header || key bits)`, with `i` from 1 in a byte
+ * and the key bits in two bytes big-endian. The nonce of a chunk is 7 zero bytes, the 32-bit big-endian
+ * index of the chunk and a byte which is 1 for the last chunk and 0 otherwise, so chunks cannot be reordered,
+ * dropped or appended without failing authentication. The header is the associated data of every chunk.
+ */
+struct vial_aes_stream {
+	union {
+		struct vial_aes_gcm_key gcm; /**< Used in GCM mode */
+		struct vial_aes_eax_key eax; /**< Used in EAX mode */
+	} key; /**< Key derived for this stream, of the size and backend of the master key */
+	enum vial_aes_mode mode;
+	size_t chunk_size;
+	uint8_t header[VIAL_AES_STREAM_HEADER_SIZE];
+};
+
+/**
+ * Starts a new stream under the master `key` in `mode` (GCM or EAX) with chunks of `2^chunk_bits` bytes.
+ * The `salt` of `VIAL_AES_STREAM_SALT_SIZE` bytes must be random, e.g. read from the system's random
+ * generator, so that every stream is sealed with a different key.
+ * The header to write before the chunks is then in `header`.
+ */
+enum vial_aes_error vial_aes_stream_init(struct vial_aes_stream *self, const struct vial_aes_key *key,
+	enum vial_aes_mode mode, unsigned chunk_bits, const uint8_t *salt);
+
+/**
+ * Reads the header of an existing stream sealed under the master `key`.
+ * Fails with `VIAL_AES_ERROR_IV` if this is not a valid header.
+ */
+enum vial_aes_error vial_aes_stream_init_header(struct vial_aes_stream *self, const struct vial_aes_key *key,
+	const uint8_t *header);
+
+/**
+ * Position of chunk `index` from the start of the stream, including the header
+ */
+uint64_t vial_aes_stream_chunk_offset(const struct vial_aes_stream *self, uint64_t index);
+
+/**
+ * Size of the stream of a message of `len` bytes, including the header
+ */
+uint64_t vial_aes_stream_size(const struct vial_aes_stream *self, uint64_t len);
+
+/**
+ * Length of the message in a stream of `size` bytes, including the header.
+ * Fails with `VIAL_AES_ERROR_LENGTH` if no stream has that size.
+ */
+enum vial_aes_error vial_aes_stream_message_size(const struct vial_aes_stream *self, uint64_t size, uint64_t *len);
+
+/**
+ * Seals `len` bytes of the message as consecutive chunks starting with chunk `index`,
+ * writing each chunk followed by its tag. Unless `last` is set, `len` must be a non-zero multiple
+ * of the chunk size, otherwise the final chunk is sealed as the last one of the stream.
+ * The chunks are split between the threads of the pool, with a NULL pool the calling thread does all the work.
+ * `dst` must not overlap `src`, as the chunks are at different positions in the two.
+ */
+enum vial_aes_error vial_aes_stream_seal(struct vial_aes_pool *pool, const struct vial_aes_stream *self,
+	uint64_t index, int last, uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Opens `len` bytes of consecutive sealed chunks starting with chunk `index`, `last` if they end with
+ * the last chunk of the stream. Each chunk is verified on its own, those failing authentication are
+ * zeroed in the output and `VIAL_AES_ERROR_MAC` is returned.
+ */
+enum vial_aes_error vial_aes_stream_open(struct vial_aes_pool *pool, const struct vial_aes_stream *self,
+	uint64_t index, int last, uint8_t *dst, const uint8_t *src, size_t len);
+
 /**
  * Stores the state/context for performing AES encryption/decryption
  */
@@ -438,6 +822,39 @@ static inline enum vial_aes_error vial_aes_check_tag(union vial_aes *self, const
 	return self->base.vtable->check_tag(&self->base, tag);
 }
 
+/**
+ * Fragment of a message for the scatter/gather functions
+ */
+struct vial_aes_iovec {
+	uint8_t *base;
+	size_t len;
+};
+
+/**
+ * Encrypts (part of) a message read from `src_count` fragments into `dst_count` fragments.
+ * The fragments may have any lengths, including zero, as long as both lists add up to the same length.
+ * Blocks straddling fragments are handled internally, so in ECB and CBC mode only the total
+ * length must be a multiple of the block size. `dst` may list the same fragments as `src`.
+ */
+enum vial_aes_error vial_aes_encrypt_iov(union vial_aes *self, const struct vial_aes_iovec *dst, size_t dst_count,
+	const struct vial_aes_iovec *src, size_t src_count);
+
+/**
+ * Decrypts (part of) a message read from `src_count` fragments into `dst_count` fragments
+ */
+enum vial_aes_error vial_aes_decrypt_iov(union vial_aes *self, const struct vial_aes_iovec *dst, size_t dst_count,
+	const struct vial_aes_iovec *src, size_t src_count);
+
+/**
+ * Processes associated data in `count` fragments for authentication
+ */
+enum vial_aes_error vial_aes_auth_update_iov(union vial_aes *self, const struct vial_aes_iovec *src, size_t count);
+
+/**
+ * Processes final associated data in `count` fragments for authentication
+ */
+enum vial_aes_error vial_aes_auth_final_iov(union vial_aes *self, const struct vial_aes_iovec *src, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,658 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+#include "aes_impl.h"
+
+#if VIAL_AES_X86
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#include "aes_clmul.h"
+
+#define AESNI_TARGET VIAL_AES_TARGET("aes,sse2")
+
+#define RK(key, i) _mm_loadu_si128((const __m128i *) &(key)->key_exp[i])
+#define DK(key, i) _mm_loadu_si128((const __m128i *) &(key)->key_dec[i])
+
+static AESNI_TARGET __m128i xor_shifted(__m128i k)
+{
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+	return _mm_xor_si128(k, _mm_slli_si128(k, 4));
+}
+
+static AESNI_TARGET __m128i expand_128(__m128i k, __m128i t)
+{
+	return _mm_xor_si128(xor_shifted(k), _mm_shuffle_epi32(t, 0xFF));
+}
+
+/* advances the 6 words of the AES-192 schedule held in `*lo` and the low half of `*hi` */
+static AESNI_TARGET void expand_192(__m128i *lo, __m128i *hi, __m128i t)
+{
+	__m128i k = _mm_xor_si128(xor_shifted(*lo), _mm_shuffle_epi32(t, 0x55));
+	t = _mm_shuffle_epi32(k, 0xFF);
+	*hi = _mm_xor_si128(_mm_xor_si128(*hi, _mm_slli_si128(*hi, 4)), t);
+	*lo = k;
+}
+
+#define EXPAND_128(i, c) rk[i] = expand_128(rk[i - 1], _mm_aeskeygenassist_si128(rk[i - 1], c))
+
+#define EXPAND_256(i, c) do { \
+	rk[i] = expand_128(rk[i - 2], _mm_aeskeygenassist_si128(rk[i - 1], c)); \
+	rk[i + 1] = _mm_xor_si128(xor_shifted(rk[i - 1]), \
+		_mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[i], 0), 0xAA)); \
+} while (0)
+
+/* two rounds of AES-192 produce three round keys, the first one sharing a register with the previous */
+#define EXPAND_192(i, c1, c2) do { \
+	expand_192(&lo, &hi, _mm_aeskeygenassist_si128(hi, c1)); \
+	rk[i] = _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(rk[i]), _mm_castsi128_pd(lo), 0)); \
+	rk[i + 1] = _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(lo), _mm_castsi128_pd(hi), 1)); \
+	expand_192(&lo, &hi, _mm_aeskeygenassist_si128(hi, c2)); \
+	rk[i + 2] = lo; \
+	rk[i + 3] = hi; \
+} while (0)
+
+AESNI_TARGET void vial_aes_aesni_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	__m128i rk[15], lo, hi;
+	unsigned i;
+	rk[0] = _mm_loadu_si128((const __m128i *) raw);
+	switch (key->rounds) {
+	case 10:
+		EXPAND_128(1, 0x01);
+		EXPAND_128(2, 0x02);
+		EXPAND_128(3, 0x04);
+		EXPAND_128(4, 0x08);
+		EXPAND_128(5, 0x10);
+		EXPAND_128(6, 0x20);
+		EXPAND_128(7, 0x40);
+		EXPAND_128(8, 0x80);
+		EXPAND_128(9, 0x1B);
+		EXPAND_128(10, 0x36);
+		break;
+	case 12:
+		lo = rk[0];
+		hi = rk[1] = _mm_loadl_epi64((const __m128i *) (raw + 16));
+		EXPAND_192(1, 0x01, 0x02);
+		EXPAND_192(4, 0x04, 0x08);
+		EXPAND_192(7, 0x10, 0x20);
+		expand_192(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x40));
+		rk[10] = _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(rk[10]), _mm_castsi128_pd(lo), 0));
+		rk[11] = _mm_castpd_si128(_mm_shuffle_pd(_mm_castsi128_pd(lo), _mm_castsi128_pd(hi), 1));
+		expand_192(&lo, &hi, _mm_aeskeygenassist_si128(hi, 0x80));
+		rk[12] = lo;
+		break;
+	default:
+		rk[1] = _mm_loadu_si128((const __m128i *) (raw + 16));
+		EXPAND_256(2, 0x01);
+		EXPAND_256(4, 0x02);
+		EXPAND_256(6, 0x04);
+		EXPAND_256(8, 0x08);
+		EXPAND_256(10, 0x10);
+		EXPAND_256(12, 0x20);
+		rk[14] = expand_128(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+		break;
+	}
+	for (i = 0; i <= key->rounds; ++i)
+		_mm_storeu_si128((__m128i *) &key->key_exp[i], rk[i]);
+	/* equivalent inverse cipher, in the order AESDEC consumes it */
+	_mm_storeu_si128((__m128i *) &key->key_dec[0], rk[key->rounds]);
+	for (i = 1; i < key->rounds; ++i)
+		_mm_storeu_si128((__m128i *) &key->key_dec[i], _mm_aesimc_si128(rk[key->rounds - i]));
+	_mm_storeu_si128((__m128i *) &key->key_dec[key->rounds], rk[0]);
+}
+
+AESNI_TARGET void vial_aes_aesni_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	__m128i blk = _mm_xor_si128(_mm_loadu_si128((const __m128i *) src), RK(key, 0));
+	unsigned r;
+	for (r = 1; r < key->rounds; ++r)
+		blk = _mm_aesenc_si128(blk, RK(key, r));
+	blk = _mm_aesenclast_si128(blk, RK(key, key->rounds));
+	_mm_storeu_si128((__m128i *) dst, blk);
+}
+
+AESNI_TARGET void vial_aes_aesni_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	__m128i blk = _mm_xor_si128(_mm_loadu_si128((const __m128i *) src), DK(key, 0));
+	unsigned r;
+	for (r = 1; r < key->rounds; ++r)
+		blk = _mm_aesdec_si128(blk, DK(key, r));
+	blk = _mm_aesdeclast_si128(blk, DK(key, key->rounds));
+	_mm_storeu_si128((__m128i *) dst, blk);
+}
+
+#define LOAD4(p) \
+	b0 = _mm_loadu_si128((const __m128i *) (p)); \
+	b1 = _mm_loadu_si128((const __m128i *) (p) + 1); \
+	b2 = _mm_loadu_si128((const __m128i *) (p) + 2); \
+	b3 = _mm_loadu_si128((const __m128i *) (p) + 3)
+
+#define LOAD8(p) \
+	LOAD4(p); \
+	b4 = _mm_loadu_si128((const __m128i *) (p) + 4); \
+	b5 = _mm_loadu_si128((const __m128i *) (p) + 5); \
+	b6 = _mm_loadu_si128((const __m128i *) (p) + 6); \
+	b7 = _mm_loadu_si128((const __m128i *) (p) + 7)
+
+#define STORE4(p) \
+	_mm_storeu_si128((__m128i *) (p), b0); \
+	_mm_storeu_si128((__m128i *) (p) + 1, b1); \
+	_mm_storeu_si128((__m128i *) (p) + 2, b2); \
+	_mm_storeu_si128((__m128i *) (p) + 3, b3)
+
+#define STORE8(p) \
+	STORE4(p); \
+	_mm_storeu_si128((__m128i *) (p) + 4, b4); \
+	_mm_storeu_si128((__m128i *) (p) + 5, b5); \
+	_mm_storeu_si128((__m128i *) (p) + 6, b6); \
+	_mm_storeu_si128((__m128i *) (p) + 7, b7)
+
+#define APPLY4(f, k) \
+	b0 = f(b0, k); \
+	b1 = f(b1, k); \
+	b2 = f(b2, k); \
+	b3 = f(b3, k)
+
+#define APPLY8(f, k) \
+	APPLY4(f, k); \
+	b4 = f(b4, k); \
+	b5 = f(b5, k); \
+	b6 = f(b6, k); \
+	b7 = f(b7, k)
+
+AESNI_TARGET void vial_aes_aesni_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+	unsigned r;
+	for (; nblocks >= 8; nblocks -= 8, src += 128, dst += 128) {
+		LOAD8(src);
+		k = RK(key, 0);
+		APPLY8(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			APPLY8(_mm_aesenc_si128, k);
+		}
+		k = RK(key, key->rounds);
+		APPLY8(_mm_aesenclast_si128, k);
+		STORE8(dst);
+	}
+	if (nblocks >= 4) {
+		LOAD4(src);
+		k = RK(key, 0);
+		APPLY4(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			APPLY4(_mm_aesenc_si128, k);
+		}
+		k = RK(key, key->rounds);
+		APPLY4(_mm_aesenclast_si128, k);
+		STORE4(dst);
+		nblocks -= 4, src += 64, dst += 64;
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16)
+		vial_aes_aesni_encrypt(key, dst, src);
+}
+
+AESNI_TARGET void vial_aes_aesni_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k;
+	unsigned r;
+	for (; nblocks >= 8; nblocks -= 8, src += 128, dst += 128) {
+		LOAD8(src);
+		k = DK(key, 0);
+		APPLY8(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = DK(key, r);
+			APPLY8(_mm_aesdec_si128, k);
+		}
+		k = DK(key, key->rounds);
+		APPLY8(_mm_aesdeclast_si128, k);
+		STORE8(dst);
+	}
+	if (nblocks >= 4) {
+		LOAD4(src);
+		k = DK(key, 0);
+		APPLY4(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = DK(key, r);
+			APPLY4(_mm_aesdec_si128, k);
+		}
+		k = DK(key, key->rounds);
+		APPLY4(_mm_aesdeclast_si128, k);
+		STORE4(dst);
+		nblocks -= 4, src += 64, dst += 64;
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16)
+		vial_aes_aesni_decrypt(key, dst, src);
+}
+
+/* 8 blocks are multiplied by descending powers of H and reduced once, fewer take the lowest powers */
+static CLMUL_TARGET void clmul_ghash_blocks(const struct vial_aes_block *pow, struct vial_aes_block *acc, const uint8_t *src,
+	size_t nblocks)
+{
+	__m128i x = bswap128(_mm_loadu_si128((const __m128i *) acc)), d, k, lo, mid, hi;
+	size_t i, n;
+	for (; nblocks > 0; nblocks -= n, src += n * VIAL_AES_BLOCK_SIZE) {
+		n = nblocks < 8 ? nblocks : 8;
+		lo = mid = hi = _mm_setzero_si128();
+		for (i = 0; i < n; ++i) {
+			d = bswap128(_mm_loadu_si128((const __m128i *) src + i));
+			if (i == 0)
+				d = _mm_xor_si128(d, x);
+			k = _mm_loadu_si128((const __m128i *) &pow[8 - n + i]);
+			lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(d, k, 0x00));
+			mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(d, k, 0x01));
+			mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(d, k, 0x10));
+			hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(d, k, 0x11));
+		}
+		x = ghash_reduce(lo, mid, hi);
+	}
+	_mm_storeu_si128((__m128i *) acc, bswap128(x));
+}
+
+#define LANES8(f, r) \
+	b0 = f(b0, RK(keys[0], r)); \
+	b1 = f(b1, RK(keys[1], r)); \
+	b2 = f(b2, RK(keys[2], r)); \
+	b3 = f(b3, RK(keys[3], r)); \
+	b4 = f(b4, RK(keys[4], r)); \
+	b5 = f(b5, RK(keys[5], r)); \
+	b6 = f(b6, RK(keys[6], r)); \
+	b7 = f(b7, RK(keys[7], r))
+
+/* the round keys are loaded per lane, as each lane has its own key */
+AESNI_TARGET void vial_aes_aesni_lanes_encrypt(const struct vial_aes_key *const *keys, struct vial_aes_block *blocks,
+	unsigned nlanes)
+{
+	const unsigned rounds = keys[0]->rounds;
+	__m128i b[VIAL_AES_LANES], b0, b1, b2, b3, b4, b5, b6, b7;
+	unsigned i, r;
+	if (nlanes == 8) {
+		/* all lanes busy, in registers */
+		LOAD8(blocks);
+		LANES8(_mm_xor_si128, 0);
+		for (r = 1; r < rounds; ++r) {
+			LANES8(_mm_aesenc_si128, r);
+		}
+		LANES8(_mm_aesenclast_si128, rounds);
+		STORE8(blocks);
+		return;
+	}
+	for (i = 0; i < nlanes; ++i)
+		b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) &blocks[i]), RK(keys[i], 0));
+	for (r = 1; r < rounds; ++r) {
+		for (i = 0; i < nlanes; ++i)
+			b[i] = _mm_aesenc_si128(b[i], RK(keys[i], r));
+	}
+	for (i = 0; i < nlanes; ++i)
+		_mm_storeu_si128((__m128i *) &blocks[i], _mm_aesenclast_si128(b[i], RK(keys[i], rounds)));
+}
+
+/* the ciphertext blocks are read again for the xor before anything is stored, so decrypting in place is safe */
+AESNI_TARGET void vial_aes_aesni_cbc_decrypt_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src,
+	size_t nblocks, uint8_t *iv)
+{
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, k, c, prev = _mm_loadu_si128((const __m128i *) iv);
+	unsigned r;
+	for (; nblocks >= 8; nblocks -= 8, src += 128, dst += 128) {
+		LOAD8(src);
+		k = DK(key, 0);
+		APPLY8(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = DK(key, r);
+			APPLY8(_mm_aesdec_si128, k);
+		}
+		k = DK(key, key->rounds);
+		APPLY8(_mm_aesdeclast_si128, k);
+		b0 = _mm_xor_si128(b0, prev);
+		b1 = _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *) src));
+		b2 = _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *) src + 1));
+		b3 = _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *) src + 2));
+		b4 = _mm_xor_si128(b4, _mm_loadu_si128((const __m128i *) src + 3));
+		b5 = _mm_xor_si128(b5, _mm_loadu_si128((const __m128i *) src + 4));
+		b6 = _mm_xor_si128(b6, _mm_loadu_si128((const __m128i *) src + 5));
+		b7 = _mm_xor_si128(b7, _mm_loadu_si128((const __m128i *) src + 6));
+		prev = _mm_loadu_si128((const __m128i *) src + 7);
+		STORE8(dst);
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16) {
+		c = _mm_loadu_si128((const __m128i *) src);
+		b0 = _mm_xor_si128(c, DK(key, 0));
+		for (r = 1; r < key->rounds; ++r)
+			b0 = _mm_aesdec_si128(b0, DK(key, r));
+		b0 = _mm_xor_si128(_mm_aesdeclast_si128(b0, DK(key, key->rounds)), prev);
+		prev = c;
+		_mm_storeu_si128((__m128i *) dst, b0);
+	}
+	_mm_storeu_si128((__m128i *) iv, prev);
+}
+
+#define CTR_TARGET VIAL_AES_TARGET("aes,ssse3")
+#define STITCH_TARGET VIAL_AES_TARGET("aes,pclmul,ssse3")
+
+#define XOR8(p) \
+	b0 = _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *) (p))); \
+	b1 = _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *) (p) + 1)); \
+	b2 = _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *) (p) + 2)); \
+	b3 = _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *) (p) + 3)); \
+	b4 = _mm_xor_si128(b4, _mm_loadu_si128((const __m128i *) (p) + 4)); \
+	b5 = _mm_xor_si128(b5, _mm_loadu_si128((const __m128i *) (p) + 5)); \
+	b6 = _mm_xor_si128(b6, _mm_loadu_si128((const __m128i *) (p) + 6)); \
+	b7 = _mm_xor_si128(b7, _mm_loadu_si128((const __m128i *) (p) + 7))
+
+#define NEXT_COUNTER(b) b = _mm_shuffle_epi8(c, rev); c = _mm_add_epi64(c, one)
+
+/* the counters are kept as a little-endian 128-bit integer in `c` and byte swapped for encryption */
+#define LOAD_COUNTERS8(bits) do { \
+	if (vial_aes_counter_fits(ctr_lo, 8, bits)) { \
+		c = _mm_set_epi64x((long long) ctr_hi, (long long) ctr_lo); \
+		NEXT_COUNTER(b0); NEXT_COUNTER(b1); NEXT_COUNTER(b2); NEXT_COUNTER(b3); \
+		NEXT_COUNTER(b4); NEXT_COUNTER(b5); NEXT_COUNTER(b6); NEXT_COUNTER(b7); \
+		vial_aes_counter_add(&ctr_hi, &ctr_lo, 8, bits); \
+	} else { \
+		for (i = 0; i < 8; ++i) { \
+			vial_aes_store_be64(buf + i * VIAL_AES_BLOCK_SIZE, ctr_hi); \
+			vial_aes_store_be64(buf + i * VIAL_AES_BLOCK_SIZE + 8, ctr_lo); \
+			vial_aes_counter_add(&ctr_hi, &ctr_lo, 1, bits); \
+		} \
+		LOAD8(buf); \
+	} \
+} while (0)
+
+/* fewer than 8 blocks, encrypted as a whole batch of which the surplus is discarded, which takes no longer */
+static CTR_TARGET void ctr_tail(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+	uint64_t *hi, uint64_t *lo, unsigned bits)
+{
+	const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m128i one = _mm_set_epi64x(0, 1);
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, c, k;
+	uint64_t ctr_hi = *hi, ctr_lo = *lo;
+	uint8_t buf[8 * VIAL_AES_BLOCK_SIZE];
+	unsigned i, r;
+	LOAD_COUNTERS8(bits);
+	k = RK(key, 0);
+	APPLY8(_mm_xor_si128, k);
+	for (r = 1; r < key->rounds; ++r) {
+		k = RK(key, r);
+		APPLY8(_mm_aesenc_si128, k);
+	}
+	k = RK(key, key->rounds);
+	APPLY8(_mm_aesenclast_si128, k);
+	STORE8(buf);
+	for (i = 0; i < nblocks; ++i) {
+		_mm_storeu_si128((__m128i *) dst + i, _mm_xor_si128(_mm_loadu_si128((const __m128i *) buf + i),
+			_mm_loadu_si128((const __m128i *) src + i)));
+	}
+	vial_aes_counter_add(hi, lo, nblocks, bits);
+}
+
+CTR_TARGET void vial_aes_aesni_ctr_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+	uint8_t *counter, unsigned bits)
+{
+	const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m128i one = _mm_set_epi64x(0, 1);
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, c, k;
+	uint64_t ctr_hi = vial_aes_load_be64(counter), ctr_lo = vial_aes_load_be64(counter + 8);
+	uint8_t buf[8 * VIAL_AES_BLOCK_SIZE];
+	unsigned i, r;
+	for (; nblocks >= 8; nblocks -= 8, src += 128, dst += 128) {
+		LOAD_COUNTERS8(bits);
+		k = RK(key, 0);
+		APPLY8(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			APPLY8(_mm_aesenc_si128, k);
+		}
+		k = RK(key, key->rounds);
+		APPLY8(_mm_aesenclast_si128, k);
+		XOR8(src);
+		STORE8(dst);
+	}
+	if (nblocks > 0)
+		ctr_tail(key, dst, src, nblocks, &ctr_hi, &ctr_lo, bits);
+	vial_aes_store_be64(counter, ctr_hi);
+	vial_aes_store_be64(counter + 8, ctr_lo);
+}
+
+/*
+ * 8 counter blocks go through the AES rounds while the 8 blocks of ciphertext hashed in this iteration are multiplied,
+ * one block per round, so the AES and carry-less multiply units are busy at the same time.
+ * When decrypting these are the input blocks, when encrypting the output of the previous iteration.
+ */
+static STITCH_TARGET void aesni_gcm_blocks(const struct vial_aes_key *key, const struct vial_aes_block *pow,
+	struct vial_aes_block *acc, uint8_t *dst, const uint8_t *src, size_t nblocks, uint8_t *counter, int decrypt)
+{
+	const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m128i one = _mm_set_epi64x(0, 1);
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7, c, k, d, h, lo, mid, hi,
+		x = bswap128(_mm_loadu_si128((const __m128i *) acc));
+	uint64_t ctr_hi = vial_aes_load_be64(counter), ctr_lo = vial_aes_load_be64(counter + 8);
+	uint8_t buf[8 * VIAL_AES_BLOCK_SIZE];
+	const uint8_t *g = NULL;
+	unsigned i, r;
+	for (; nblocks >= 8; nblocks -= 8, src += 128, dst += 128) {
+		LOAD_COUNTERS8(32);
+		if (decrypt)
+			g = src;
+		lo = mid = hi = _mm_setzero_si128();
+		k = RK(key, 0);
+		APPLY8(_mm_xor_si128, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			APPLY8(_mm_aesenc_si128, k);
+			if (g != NULL && r <= 8) {
+				d = bswap128(_mm_loadu_si128((const __m128i *) g + (r - 1)));
+				if (r == 1)
+					d = _mm_xor_si128(d, x);
+				h = _mm_loadu_si128((const __m128i *) &pow[r - 1]);
+				lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(d, h, 0x00));
+				mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(d, h, 0x01));
+				mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(d, h, 0x10));
+				hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(d, h, 0x11));
+			}
+		}
+		k = RK(key, key->rounds);
+		APPLY8(_mm_aesenclast_si128, k);
+		if (g != NULL)
+			x = ghash_reduce(lo, mid, hi);
+		XOR8(src);
+		STORE8(dst);
+		if (!decrypt)
+			g = dst;
+	}
+	_mm_storeu_si128((__m128i *) acc, bswap128(x));
+	if (!decrypt && g != NULL)
+		clmul_ghash_blocks(pow, acc, g, 8);
+	/* remaining blocks in separate passes */
+	if (nblocks > 0) {
+		if (decrypt)
+			clmul_ghash_blocks(pow, acc, src, nblocks);
+		ctr_tail(key, dst, src, nblocks, &ctr_hi, &ctr_lo, 32);
+		if (!decrypt)
+			clmul_ghash_blocks(pow, acc, dst, nblocks);
+	}
+	vial_aes_store_be64(counter, ctr_hi);
+	vial_aes_store_be64(counter + 8, ctr_lo);
+}
+
+/*
+ * The CBC-MAC is a serial chain which leaves the AES unit idle for most of each round's latency,
+ * so the counter block of the same position is encrypted alongside it for free, as is the header chain.
+ * Both only depend on the previous iteration: the ciphertext is xored into the MAC after the rounds.
+ */
+CTR_TARGET void vial_aes_aesni_eax_blocks(const struct vial_aes_key *key, struct vial_aes_block *mac, uint8_t *dst,
+	const uint8_t *src, size_t nblocks, uint8_t *counter, unsigned bits, int decrypt, struct vial_aes_block *hmac,
+	const uint8_t *hsrc, size_t hblocks)
+{
+	const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i m = _mm_loadu_si128((const __m128i *) mac), h = _mm_setzero_si128(), c, d, k;
+	uint64_t ctr_hi = vial_aes_load_be64(counter), ctr_lo = vial_aes_load_be64(counter + 8);
+	unsigned r;
+	if (hmac != NULL)
+		h = _mm_loadu_si128((const __m128i *) hmac);
+	for (; nblocks > 0 && hblocks > 0; --nblocks, --hblocks, src += 16, dst += 16, hsrc += 16) {
+		c = _mm_shuffle_epi8(_mm_set_epi64x((long long) ctr_hi, (long long) ctr_lo), rev);
+		vial_aes_counter_add(&ctr_hi, &ctr_lo, 1, bits);
+		k = RK(key, 0);
+		m = _mm_xor_si128(m, k);
+		c = _mm_xor_si128(c, k);
+		h = _mm_xor_si128(h, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			m = _mm_aesenc_si128(m, k);
+			c = _mm_aesenc_si128(c, k);
+			h = _mm_aesenc_si128(h, k);
+		}
+		k = RK(key, key->rounds);
+		m = _mm_aesenclast_si128(m, k);
+		c = _mm_aesenclast_si128(c, k);
+		h = _mm_xor_si128(_mm_aesenclast_si128(h, k), _mm_loadu_si128((const __m128i *) hsrc));
+		d = _mm_loadu_si128((const __m128i *) src);
+		c = _mm_xor_si128(c, d);
+		m = _mm_xor_si128(m, decrypt ? d : c);
+		_mm_storeu_si128((__m128i *) dst, c);
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16) {
+		c = _mm_shuffle_epi8(_mm_set_epi64x((long long) ctr_hi, (long long) ctr_lo), rev);
+		vial_aes_counter_add(&ctr_hi, &ctr_lo, 1, bits);
+		k = RK(key, 0);
+		m = _mm_xor_si128(m, k);
+		c = _mm_xor_si128(c, k);
+		for (r = 1; r < key->rounds; ++r) {
+			k = RK(key, r);
+			m = _mm_aesenc_si128(m, k);
+			c = _mm_aesenc_si128(c, k);
+		}
+		k = RK(key, key->rounds);
+		m = _mm_aesenclast_si128(m, k);
+		c = _mm_aesenclast_si128(c, k);
+		d = _mm_loadu_si128((const __m128i *) src);
+		c = _mm_xor_si128(c, d);
+		m = _mm_xor_si128(m, decrypt ? d : c);
+		_mm_storeu_si128((__m128i *) dst, c);
+	}
+	/* a header longer than the message */
+	for (; hblocks > 0; --hblocks, hsrc += 16) {
+		h = _mm_xor_si128(h, RK(key, 0));
+		for (r = 1; r < key->rounds; ++r)
+			h = _mm_aesenc_si128(h, RK(key, r));
+		h = _mm_xor_si128(_mm_aesenclast_si128(h, RK(key, key->rounds)), _mm_loadu_si128((const __m128i *) hsrc));
+	}
+	_mm_storeu_si128((__m128i *) mac, m);
+	if (hmac != NULL)
+		_mm_storeu_si128((__m128i *) hmac, h);
+	vial_aes_store_be64(counter, ctr_hi);
+	vial_aes_store_be64(counter + 8, ctr_lo);
+}
+
+static AESNI_TARGET void aesni_key_init(struct vial_aes_key *key, const uint8_t *raw);
+
+static const struct vial_aes_impl aesni_impl = {
+	VIAL_AES_BACKEND_AESNI,
+	aesni_key_init,
+	vial_aes_aesni_encrypt,
+	vial_aes_aesni_decrypt,
+	vial_aes_aesni_blocks_encrypt,
+	vial_aes_aesni_blocks_decrypt,
+	vial_aes_aesni_ctr_blocks,
+	NULL,
+	NULL,
+	NULL,
+	vial_aes_aesni_cbc_decrypt_blocks,
+	vial_aes_aesni_lanes_encrypt,
+	vial_aes_aesni_eax_blocks
+};
+
+/* unrolled single block kernels for each key size, used by the serial modes */
+
+#define ENC(r) blk = _mm_aesenc_si128(blk, RK(key, r));
+#define ENC_ROUNDS_10 ENC(1) ENC(2) ENC(3) ENC(4) ENC(5) ENC(6) ENC(7) ENC(8) ENC(9)
+#define ENC_ROUNDS_12 ENC_ROUNDS_10 ENC(10) ENC(11)
+#define ENC_ROUNDS_14 ENC_ROUNDS_12 ENC(12) ENC(13)
+
+#define DEC(r) blk = _mm_aesdec_si128(blk, DK(key, r));
+#define DEC_ROUNDS_10 DEC(1) DEC(2) DEC(3) DEC(4) DEC(5) DEC(6) DEC(7) DEC(8) DEC(9)
+#define DEC_ROUNDS_12 DEC_ROUNDS_10 DEC(10) DEC(11)
+#define DEC_ROUNDS_14 DEC_ROUNDS_12 DEC(12) DEC(13)
+
+#define AESNI_KERNELS(n) \
+static AESNI_TARGET void aesni_encrypt_##n(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src) \
+{ \
+	__m128i blk = _mm_xor_si128(_mm_loadu_si128((const __m128i *) src), RK(key, 0)); \
+	ENC_ROUNDS_##n \
+	_mm_storeu_si128((__m128i *) dst, _mm_aesenclast_si128(blk, RK(key, n))); \
+} \
+static AESNI_TARGET void aesni_decrypt_##n(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src) \
+{ \
+	__m128i blk = _mm_xor_si128(_mm_loadu_si128((const __m128i *) src), DK(key, 0)); \
+	DEC_ROUNDS_##n \
+	_mm_storeu_si128((__m128i *) dst, _mm_aesdeclast_si128(blk, DK(key, n))); \
+} \
+static const struct vial_aes_impl aesni_impl_##n = { \
+	VIAL_AES_BACKEND_AESNI, \
+	aesni_key_init, \
+	aesni_encrypt_##n, \
+	aesni_decrypt_##n, \
+	vial_aes_aesni_blocks_encrypt, \
+	vial_aes_aesni_blocks_decrypt, \
+	vial_aes_aesni_ctr_blocks, \
+	NULL, \
+	NULL, \
+	NULL, \
+	vial_aes_aesni_cbc_decrypt_blocks, \
+	vial_aes_aesni_lanes_encrypt, \
+	vial_aes_aesni_eax_blocks \
+}; \
+static const struct vial_aes_impl aesni_clmul_impl_##n = { \
+	VIAL_AES_BACKEND_AESNI, \
+	aesni_key_init, \
+	aesni_encrypt_##n, \
+	aesni_decrypt_##n, \
+	vial_aes_aesni_blocks_encrypt, \
+	vial_aes_aesni_blocks_decrypt, \
+	vial_aes_aesni_ctr_blocks, \
+	clmul_ghash_init, \
+	clmul_ghash_blocks, \
+	aesni_gcm_blocks, \
+	vial_aes_aesni_cbc_decrypt_blocks, \
+	vial_aes_aesni_lanes_encrypt, \
+	vial_aes_aesni_eax_blocks \
+};
+
+AESNI_KERNELS(10)
+AESNI_KERNELS(12)
+AESNI_KERNELS(14)
+
+static AESNI_TARGET void aesni_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	vial_aes_aesni_key_init(key, raw);
+	/* PCLMULQDQ is a separate feature, without it GCM uses the portable GHASH */
+	if (vial_aes_cpu_features() & VIAL_AES_CPU_PCLMUL)
+		key->impl = key->rounds == 10 ? &aesni_clmul_impl_10 : key->rounds == 12 ? &aesni_clmul_impl_12 : &aesni_clmul_impl_14;
+	else
+		key->impl = key->rounds == 10 ? &aesni_impl_10 : key->rounds == 12 ? &aesni_impl_12 : &aesni_impl_14;
+}
+
+const struct vial_aes_impl *vial_aes_impl_aesni(void)
+{
+	/* the counter and GHASH code byte swap with pshufb, and a virtual machine may hide SSSE3 while exposing AES-NI */
+	const unsigned required = VIAL_AES_CPU_AESNI | VIAL_AES_CPU_SSSE3;
+	return (vial_aes_cpu_features() & required) == required ? &aesni_impl : NULL;
+}
+
+#else
+
+const struct vial_aes_impl *vial_aes_impl_aesni(void)
+{
+	return NULL;
+}
+
+#endif
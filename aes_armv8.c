@@ -0,0 +1,385 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* AArch64 Cryptographic Extension: AESE performs AddRoundKey, SubBytes and ShiftRows,
+AESMC performs MixColumns, so the round keys are applied one step earlier than with AES-NI. */
+
+#include "aes_impl.h"
+
+#if VIAL_AES_ARM64
+
+#include <string.h>
+#include <arm_neon.h>
+
+#if defined(__clang__)
+#define ARMV8_TARGET VIAL_AES_TARGET("crypto")
+#else
+#define ARMV8_TARGET VIAL_AES_TARGET("+crypto")
+#endif
+
+#define RK(key, i) vld1q_u8((const uint8_t *) &(key)->key_exp[i])
+#define DK(key, i) vld1q_u8((const uint8_t *) &(key)->key_dec[i])
+
+/* with all columns equal, ShiftRows has no effect */
+static ARMV8_TARGET uint32_t sub_word(uint32_t w)
+{
+	uint8x16_t x = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+	return vgetq_lane_u32(vreinterpretq_u32_u8(x), 0);
+}
+
+static ARMV8_TARGET void armv8_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	const unsigned nk = key->rounds - 6, nw = 4 * (key->rounds + 1);
+	uint32_t w[60], t, rcon = 1;
+	unsigned i;
+	/* words in memory order, the first byte is the least significant */
+	memcpy(w, raw, nk * 4);
+	for (i = nk; i < nw; ++i) {
+		t = w[i - 1];
+		if (i % nk == 0) {
+			t = sub_word((t >> 8) | (t << 24)) ^ rcon;
+			rcon = ((rcon << 1) ^ (0x1B & -(rcon >> 7))) & 0xFF;
+		} else if (nk == 8 && i % nk == 4) {
+			t = sub_word(t);
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+	memcpy(key->key_exp, w, nw * 4);
+	/* equivalent inverse cipher */
+	vst1q_u8((uint8_t *) &key->key_dec[0], RK(key, key->rounds));
+	for (i = 1; i < key->rounds; ++i)
+		vst1q_u8((uint8_t *) &key->key_dec[i], vaesimcq_u8(RK(key, key->rounds - i)));
+	vst1q_u8((uint8_t *) &key->key_dec[key->rounds], RK(key, 0));
+}
+
+static ARMV8_TARGET void armv8_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	uint8x16_t blk = vld1q_u8(src);
+	unsigned r;
+	for (r = 0; r < key->rounds - 1; ++r)
+		blk = vaesmcq_u8(vaeseq_u8(blk, RK(key, r)));
+	blk = veorq_u8(vaeseq_u8(blk, RK(key, r)), RK(key, r + 1));
+	vst1q_u8(dst, blk);
+}
+
+static ARMV8_TARGET void armv8_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	uint8x16_t blk = vld1q_u8(src);
+	unsigned r;
+	for (r = 0; r < key->rounds - 1; ++r)
+		blk = vaesimcq_u8(vaesdq_u8(blk, DK(key, r)));
+	blk = veorq_u8(vaesdq_u8(blk, DK(key, r)), DK(key, r + 1));
+	vst1q_u8(dst, blk);
+}
+
+#define LOAD4(p) \
+	b0 = vld1q_u8(p); \
+	b1 = vld1q_u8((p) + 16); \
+	b2 = vld1q_u8((p) + 32); \
+	b3 = vld1q_u8((p) + 48)
+
+#define STORE4(p) \
+	vst1q_u8(p, b0); \
+	vst1q_u8((p) + 16, b1); \
+	vst1q_u8((p) + 32, b2); \
+	vst1q_u8((p) + 48, b3)
+
+#define ROUND4(f, g, k) \
+	b0 = f(g(b0, k)); \
+	b1 = f(g(b1, k)); \
+	b2 = f(g(b2, k)); \
+	b3 = f(g(b3, k))
+
+#define LAST4(g, k, l) \
+	b0 = veorq_u8(g(b0, k), l); \
+	b1 = veorq_u8(g(b1, k), l); \
+	b2 = veorq_u8(g(b2, k), l); \
+	b3 = veorq_u8(g(b3, k), l)
+
+static ARMV8_TARGET void armv8_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	uint8x16_t b0, b1, b2, b3, k;
+	unsigned r;
+	for (; nblocks >= 4; nblocks -= 4, src += 64, dst += 64) {
+		LOAD4(src);
+		for (r = 0; r < key->rounds - 1; ++r) {
+			k = RK(key, r);
+			ROUND4(vaesmcq_u8, vaeseq_u8, k);
+		}
+		LAST4(vaeseq_u8, RK(key, r), RK(key, r + 1));
+		STORE4(dst);
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16)
+		armv8_encrypt(key, dst, src);
+}
+
+static ARMV8_TARGET void armv8_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	uint8x16_t b0, b1, b2, b3, k;
+	unsigned r;
+	for (; nblocks >= 4; nblocks -= 4, src += 64, dst += 64) {
+		LOAD4(src);
+		for (r = 0; r < key->rounds - 1; ++r) {
+			k = DK(key, r);
+			ROUND4(vaesimcq_u8, vaesdq_u8, k);
+		}
+		LAST4(vaesdq_u8, DK(key, r), DK(key, r + 1));
+		STORE4(dst);
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16)
+		armv8_decrypt(key, dst, src);
+}
+
+/* the round keys are loaded per lane, as each lane has its own key */
+static ARMV8_TARGET void armv8_lanes_encrypt(const struct vial_aes_key *const *keys, struct vial_aes_block *blocks,
+	unsigned nlanes)
+{
+	const unsigned rounds = keys[0]->rounds;
+	uint8x16_t b[VIAL_AES_LANES];
+	unsigned i, r;
+	for (i = 0; i < nlanes; ++i)
+		b[i] = vld1q_u8((const uint8_t *) &blocks[i]);
+	for (r = 0; r < rounds - 1; ++r) {
+		for (i = 0; i < nlanes; ++i)
+			b[i] = vaesmcq_u8(vaeseq_u8(b[i], RK(keys[i], r)));
+	}
+	for (i = 0; i < nlanes; ++i)
+		vst1q_u8((uint8_t *) &blocks[i], veorq_u8(vaeseq_u8(b[i], RK(keys[i], r)), RK(keys[i], r + 1)));
+}
+
+/* the ciphertext blocks are read again for the xor before anything is stored, so decrypting in place is safe */
+static ARMV8_TARGET void armv8_cbc_decrypt_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src,
+	size_t nblocks, uint8_t *iv)
+{
+	uint8x16_t b0, b1, b2, b3, k, c, prev = vld1q_u8(iv);
+	unsigned r;
+	for (; nblocks >= 4; nblocks -= 4, src += 64, dst += 64) {
+		LOAD4(src);
+		for (r = 0; r < key->rounds - 1; ++r) {
+			k = DK(key, r);
+			ROUND4(vaesimcq_u8, vaesdq_u8, k);
+		}
+		LAST4(vaesdq_u8, DK(key, r), DK(key, r + 1));
+		b0 = veorq_u8(b0, prev);
+		b1 = veorq_u8(b1, vld1q_u8(src));
+		b2 = veorq_u8(b2, vld1q_u8(src + 16));
+		b3 = veorq_u8(b3, vld1q_u8(src + 32));
+		prev = vld1q_u8(src + 48);
+		STORE4(dst);
+	}
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16) {
+		c = vld1q_u8(src);
+		b0 = c;
+		for (r = 0; r < key->rounds - 1; ++r)
+			b0 = vaesimcq_u8(vaesdq_u8(b0, DK(key, r)));
+		b0 = veorq_u8(veorq_u8(vaesdq_u8(b0, DK(key, r)), DK(key, r + 1)), prev);
+		prev = c;
+		vst1q_u8(dst, b0);
+	}
+	vst1q_u8(iv, prev);
+}
+
+/* the counter block and the header chain are encrypted alongside the serial CBC-MAC chain, see the AES-NI backend */
+static ARMV8_TARGET void armv8_eax_blocks(const struct vial_aes_key *key, struct vial_aes_block *mac, uint8_t *dst,
+	const uint8_t *src, size_t nblocks, uint8_t *counter, unsigned bits, int decrypt, struct vial_aes_block *hmac,
+	const uint8_t *hsrc, size_t hblocks)
+{
+	uint8x16_t m = vld1q_u8((const uint8_t *) mac), h = vdupq_n_u8(0), c, d, k;
+	uint64_t ctr_hi = vial_aes_load_be64(counter), ctr_lo = vial_aes_load_be64(counter + 8);
+	uint8_t buf[VIAL_AES_BLOCK_SIZE];
+	unsigned r;
+	if (hmac != NULL)
+		h = vld1q_u8((const uint8_t *) hmac);
+	for (; nblocks > 0; --nblocks, src += 16, dst += 16) {
+		vial_aes_store_be64(buf, ctr_hi);
+		vial_aes_store_be64(buf + 8, ctr_lo);
+		vial_aes_counter_add(&ctr_hi, &ctr_lo, 1, bits);
+		c = vld1q_u8(buf);
+		if (hblocks > 0) {
+			for (r = 0; r < key->rounds - 1; ++r) {
+				k = RK(key, r);
+				m = vaesmcq_u8(vaeseq_u8(m, k));
+				c = vaesmcq_u8(vaeseq_u8(c, k));
+				h = vaesmcq_u8(vaeseq_u8(h, k));
+			}
+			h = veorq_u8(veorq_u8(vaeseq_u8(h, RK(key, r)), RK(key, r + 1)), vld1q_u8(hsrc));
+			--hblocks;
+			hsrc += 16;
+		} else {
+			for (r = 0; r < key->rounds - 1; ++r) {
+				k = RK(key, r);
+				m = vaesmcq_u8(vaeseq_u8(m, k));
+				c = vaesmcq_u8(vaeseq_u8(c, k));
+			}
+		}
+		k = RK(key, r + 1);
+		m = veorq_u8(vaeseq_u8(m, RK(key, r)), k);
+		c = veorq_u8(vaeseq_u8(c, RK(key, r)), k);
+		d = vld1q_u8(src);
+		c = veorq_u8(c, d);
+		m = veorq_u8(m, decrypt ? d : c);
+		vst1q_u8(dst, c);
+	}
+	/* a header longer than the message */
+	for (; hblocks > 0; --hblocks, hsrc += 16) {
+		for (r = 0; r < key->rounds - 1; ++r)
+			h = vaesmcq_u8(vaeseq_u8(h, RK(key, r)));
+		h = veorq_u8(veorq_u8(vaeseq_u8(h, RK(key, r)), RK(key, r + 1)), vld1q_u8(hsrc));
+	}
+	vst1q_u8((uint8_t *) mac, m);
+	if (hmac != NULL)
+		vst1q_u8((uint8_t *) hmac, h);
+	vial_aes_store_be64(counter, ctr_hi);
+	vial_aes_store_be64(counter + 8, ctr_lo);
+}
+
+/* GHASH on byte-reversed blocks, using the same representation and reduction as the x86 backends */
+
+#define SHL_BYTES(x, n) vextq_u8(vdupq_n_u8(0), x, 16 - (n))
+#define SHR_BYTES(x, n) vextq_u8(x, vdupq_n_u8(0), n)
+#define SHL32(x, n) vreinterpretq_u8_u32(vshlq_n_u32(vreinterpretq_u32_u8(x), n))
+#define SHR32(x, n) vreinterpretq_u8_u32(vshrq_n_u32(vreinterpretq_u32_u8(x), n))
+
+static ARMV8_TARGET uint8x16_t pmull_lo(uint8x16_t a, uint8x16_t b)
+{
+	return vreinterpretq_u8_p128(vmull_p64(
+		(poly64_t) vgetq_lane_u64(vreinterpretq_u64_u8(a), 0),
+		(poly64_t) vgetq_lane_u64(vreinterpretq_u64_u8(b), 0)));
+}
+
+static ARMV8_TARGET uint8x16_t pmull_hi(uint8x16_t a, uint8x16_t b)
+{
+	return vreinterpretq_u8_p128(vmull_high_p64(vreinterpretq_p64_u8(a), vreinterpretq_p64_u8(b)));
+}
+
+static ARMV8_TARGET uint8x16_t bswap128(uint8x16_t x)
+{
+	x = vrev64q_u8(x);
+	return vextq_u8(x, x, 8);
+}
+
+static ARMV8_TARGET uint8x16_t ghash_reduce(uint8x16_t lo, uint8x16_t mid, uint8x16_t hi)
+{
+	uint8x16_t t0, t1, t2;
+	lo = veorq_u8(lo, SHL_BYTES(mid, 8));
+	hi = veorq_u8(hi, SHR_BYTES(mid, 8));
+	/* shift the 256-bit product left by one */
+	t0 = SHR32(lo, 31);
+	t1 = SHR32(hi, 31);
+	lo = SHL32(lo, 1);
+	hi = SHL32(hi, 1);
+	t2 = SHR_BYTES(t0, 12);
+	t1 = SHL_BYTES(t1, 4);
+	t0 = SHL_BYTES(t0, 4);
+	lo = vorrq_u8(lo, t0);
+	hi = vorrq_u8(vorrq_u8(hi, t1), t2);
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t0 = veorq_u8(veorq_u8(SHL32(lo, 31), SHL32(lo, 30)), SHL32(lo, 25));
+	t1 = SHR_BYTES(t0, 4);
+	lo = veorq_u8(lo, SHL_BYTES(t0, 12));
+	t2 = veorq_u8(veorq_u8(SHR32(lo, 1), SHR32(lo, 2)), SHR32(lo, 7));
+	lo = veorq_u8(lo, veorq_u8(t2, t1));
+	return veorq_u8(hi, lo);
+}
+
+#define GHASH_MULT(d, k) do { \
+	uint8x16_t ks = vextq_u8(k, k, 8); \
+	lo = veorq_u8(lo, pmull_lo(d, k)); \
+	hi = veorq_u8(hi, pmull_hi(d, k)); \
+	mid = veorq_u8(mid, veorq_u8(pmull_lo(d, ks), pmull_hi(d, ks))); \
+} while (0)
+
+static ARMV8_TARGET uint8x16_t ghash_mult(uint8x16_t a, uint8x16_t b)
+{
+	uint8x16_t lo = vdupq_n_u8(0), mid = lo, hi = lo;
+	GHASH_MULT(a, b);
+	return ghash_reduce(lo, mid, hi);
+}
+
+/* stores H^8, ..., H^1 so that the powers line up with 8 consecutive blocks */
+static ARMV8_TARGET void armv8_ghash_init(struct vial_aes_block *pow, const uint8_t *hash_key)
+{
+	uint8x16_t h = bswap128(vld1q_u8(hash_key)), x = h;
+	unsigned i;
+	vst1q_u8((uint8_t *) &pow[7], h);
+	for (i = 7; i --> 0;) {
+		x = ghash_mult(x, h);
+		vst1q_u8((uint8_t *) &pow[i], x);
+	}
+}
+
+/* fewer than 8 blocks take the lowest powers, so that they are still reduced once */
+static ARMV8_TARGET void armv8_ghash_blocks(const struct vial_aes_block *pow, struct vial_aes_block *acc, const uint8_t *src,
+	size_t nblocks)
+{
+	uint8x16_t x = bswap128(vld1q_u8((const uint8_t *) acc)), d, k, lo, mid, hi;
+	size_t i, n;
+	for (; nblocks > 0; nblocks -= n, src += n * VIAL_AES_BLOCK_SIZE) {
+		n = nblocks < 8 ? nblocks : 8;
+		lo = mid = hi = vdupq_n_u8(0);
+		for (i = 0; i < n; ++i) {
+			d = bswap128(vld1q_u8(src + 16 * i));
+			if (i == 0)
+				d = veorq_u8(d, x);
+			k = vld1q_u8((const uint8_t *) &pow[8 - n + i]);
+			GHASH_MULT(d, k);
+		}
+		x = ghash_reduce(lo, mid, hi);
+	}
+	vst1q_u8((uint8_t *) acc, bswap128(x));
+}
+
+static const struct vial_aes_impl armv8_impl = {
+	VIAL_AES_BACKEND_ARMV8,
+	armv8_key_init,
+	armv8_encrypt,
+	armv8_decrypt,
+	armv8_blocks_encrypt,
+	armv8_blocks_decrypt,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	armv8_cbc_decrypt_blocks,
+	armv8_lanes_encrypt,
+	armv8_eax_blocks
+};
+
+/* PMULL is a separate feature, although every known core with AES has it */
+static const struct vial_aes_impl armv8_pmull_impl = {
+	VIAL_AES_BACKEND_ARMV8,
+	armv8_key_init,
+	armv8_encrypt,
+	armv8_decrypt,
+	armv8_blocks_encrypt,
+	armv8_blocks_decrypt,
+	NULL,
+	armv8_ghash_init,
+	armv8_ghash_blocks,
+	NULL,
+	armv8_cbc_decrypt_blocks,
+	armv8_lanes_encrypt,
+	armv8_eax_blocks
+};
+
+const struct vial_aes_impl *vial_aes_impl_armv8(void)
+{
+	const unsigned features = vial_aes_cpu_features();
+	if (!(features & VIAL_AES_CPU_ARMV8_AES))
+		return NULL;
+	return (features & VIAL_AES_CPU_PMULL) ? &armv8_pmull_impl : &armv8_impl;
+}
+
+#else
+
+const struct vial_aes_impl *vial_aes_impl_armv8(void)
+{
+	return NULL;
+}
+
+#endif
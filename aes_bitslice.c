@@ -0,0 +1,687 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Constant-time bitsliced implementation, after the ct64 code of BearSSL by Thomas Pornin.
+Four blocks are held in eight 64-bit words, one word per bit of every state byte,
+so that the S-box is computed with logic operations instead of table lookups.
+Where the compiler supports vector extensions, each word is a pair of 64-bit lanes
+carrying two independent groups of four blocks. */
+
+#include "aes_impl.h"
+
+#include <string.h>
+
+#ifdef __GNUC__
+typedef uint64_t word __attribute__((vector_size(16)));
+#define WIDTH 2
+#else
+typedef uint64_t word;
+#define WIDTH 1
+#endif
+
+#define LANES (4 * WIDTH)
+
+/* S-box circuit by Boyar and Peralta, "A new combinational logic minimization technique
+with applications to cryptology" */
+static void bitslice_sbox(word *q)
+{
+	word x0, x1, x2, x3, x4, x5, x6, x7;
+	word y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	word y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	word y20, y21;
+	word z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	word z10, z11, z12, z13, z14, z15, z16, z17;
+	word t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	word t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	word t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	word t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	word t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	word t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	word t60, t61, t62, t63, t64, t65, t66, t67;
+	word s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* non-linear section */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/* inverse of the affine transformation of the S-box, applied around it for the inverse S-box */
+static void inv_affine(word *q)
+{
+	word q0, q1, q2, q3, q4, q5, q6, q7;
+	q0 = ~q[0];
+	q1 = ~q[1];
+	q2 = q[2];
+	q3 = q[3];
+	q4 = q[4];
+	q5 = ~q[5];
+	q6 = ~q[6];
+	q7 = q[7];
+	q[7] = q1 ^ q4 ^ q6;
+	q[6] = q0 ^ q3 ^ q5;
+	q[5] = q7 ^ q2 ^ q4;
+	q[4] = q6 ^ q1 ^ q3;
+	q[3] = q5 ^ q0 ^ q2;
+	q[2] = q4 ^ q7 ^ q1;
+	q[1] = q3 ^ q6 ^ q0;
+	q[0] = q2 ^ q5 ^ q7;
+}
+
+static void bitslice_inv_sbox(word *q)
+{
+	inv_affine(q);
+	bitslice_sbox(q);
+	inv_affine(q);
+}
+
+#define SWAPN(cl, ch, s, x, y) do { \
+	word a = (x), b = (y); \
+	(x) = (a & (uint64_t) cl) | ((b & (uint64_t) cl) << (s)); \
+	(y) = ((a & (uint64_t) ch) >> (s)) | (b & (uint64_t) ch); \
+} while (0)
+
+#define SWAP2(x, y) SWAPN(0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1, x, y)
+#define SWAP4(x, y) SWAPN(0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2, x, y)
+#define SWAP8(x, y) SWAPN(0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4, x, y)
+
+/* converts between the interleaved and the bitsliced representation, it is its own inverse */
+static void ortho(word *q)
+{
+	SWAP2(q[0], q[1]);
+	SWAP2(q[2], q[3]);
+	SWAP2(q[4], q[5]);
+	SWAP2(q[6], q[7]);
+
+	SWAP4(q[0], q[2]);
+	SWAP4(q[1], q[3]);
+	SWAP4(q[4], q[6]);
+	SWAP4(q[5], q[7]);
+
+	SWAP8(q[0], q[4]);
+	SWAP8(q[1], q[5]);
+	SWAP8(q[2], q[6]);
+	SWAP8(q[3], q[7]);
+}
+
+static void interleave_in(uint64_t *q0, uint64_t *q1, const uint32_t *w)
+{
+	uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+	x0 |= x0 << 16;
+	x1 |= x1 << 16;
+	x2 |= x2 << 16;
+	x3 |= x3 << 16;
+	x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x0 |= x0 << 8;
+	x1 |= x1 << 8;
+	x2 |= x2 << 8;
+	x3 |= x3 << 8;
+	x0 &= (uint64_t) 0x00FF00FF00FF00FF;
+	x1 &= (uint64_t) 0x00FF00FF00FF00FF;
+	x2 &= (uint64_t) 0x00FF00FF00FF00FF;
+	x3 &= (uint64_t) 0x00FF00FF00FF00FF;
+	*q0 = x0 | (x2 << 8);
+	*q1 = x1 | (x3 << 8);
+}
+
+static void interleave_out(uint32_t *w, uint64_t q0, uint64_t q1)
+{
+	uint64_t x0, x1, x2, x3;
+	x0 = q0 & (uint64_t) 0x00FF00FF00FF00FF;
+	x1 = q1 & (uint64_t) 0x00FF00FF00FF00FF;
+	x2 = (q0 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+	x3 = (q1 >> 8) & (uint64_t) 0x00FF00FF00FF00FF;
+	x0 |= x0 >> 8;
+	x1 |= x1 >> 8;
+	x2 |= x2 >> 8;
+	x3 |= x3 >> 8;
+	x0 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x1 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x2 &= (uint64_t) 0x0000FFFF0000FFFF;
+	x3 &= (uint64_t) 0x0000FFFF0000FFFF;
+	w[0] = (uint32_t) x0 | (uint32_t) (x0 >> 16);
+	w[1] = (uint32_t) x1 | (uint32_t) (x1 >> 16);
+	w[2] = (uint32_t) x2 | (uint32_t) (x2 >> 16);
+	w[3] = (uint32_t) x3 | (uint32_t) (x3 >> 16);
+}
+
+static word broadcast(uint64_t x)
+{
+	uint64_t s[WIDTH];
+	word w;
+	for (unsigned i = 0; i < WIDTH; ++i)
+		s[i] = x;
+	memcpy(&w, s, sizeof(w));
+	return w;
+}
+
+static uint32_t load_le(const uint8_t *src)
+{
+	return (uint32_t) src[0] | ((uint32_t) src[1] << 8) | ((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static void store_le(uint8_t *dst, uint32_t w)
+{
+	dst[0] = w;
+	dst[1] = w >> 8;
+	dst[2] = w >> 16;
+	dst[3] = w >> 24;
+}
+
+static uint32_t sub_word(uint32_t x)
+{
+	uint64_t s[8 * WIDTH] = {0};
+	word q[8];
+	s[0] = x;
+	memcpy(q, s, sizeof(q));
+	ortho(q);
+	bitslice_sbox(q);
+	ortho(q);
+	memcpy(s, q, sizeof(q));
+	return (uint32_t) s[0];
+}
+
+/* the scalar round key words apply to every lane */
+static void add_round_key(word *q, const uint64_t *sk)
+{
+	q[0] ^= sk[0];
+	q[1] ^= sk[1];
+	q[2] ^= sk[2];
+	q[3] ^= sk[3];
+	q[4] ^= sk[4];
+	q[5] ^= sk[5];
+	q[6] ^= sk[6];
+	q[7] ^= sk[7];
+}
+
+static void shift_rows(word *q)
+{
+	word x;
+	for (int i = 0; i < 8; ++i) {
+		x = q[i];
+		q[i] = (x & (uint64_t) 0x000000000000FFFF)
+			| ((x & (uint64_t) 0x00000000FFF00000) >> 4)
+			| ((x & (uint64_t) 0x00000000000F0000) << 12)
+			| ((x & (uint64_t) 0x0000FF0000000000) >> 8)
+			| ((x & (uint64_t) 0x000000FF00000000) << 8)
+			| ((x & (uint64_t) 0xF000000000000000) >> 12)
+			| ((x & (uint64_t) 0x0FFF000000000000) << 4);
+	}
+}
+
+static void inv_shift_rows(word *q)
+{
+	word x;
+	for (int i = 0; i < 8; ++i) {
+		x = q[i];
+		q[i] = (x & (uint64_t) 0x000000000000FFFF)
+			| ((x & (uint64_t) 0x000000000FFF0000) << 4)
+			| ((x & (uint64_t) 0x00000000F0000000) >> 12)
+			| ((x & (uint64_t) 0x000000FF00000000) << 8)
+			| ((x & (uint64_t) 0x0000FF0000000000) >> 8)
+			| ((x & (uint64_t) 0x000F000000000000) << 12)
+			| ((x & (uint64_t) 0xFFF0000000000000) >> 4);
+	}
+}
+
+#define ROTR16(x) (((x) >> 16) | ((x) << 48))
+#define ROTR32(x) (((x) >> 32) | ((x) << 32))
+
+/* move column `c + k` of every row to column `c`, as the skipped shifts of the rows left them */
+#define COLUMNS_0(x) (x)
+#define COLUMNS_1(x) ((((x) >> 4) & (uint64_t) 0x0FFF0FFF0FFF0FFF) | (((x) << 12) & (uint64_t) 0xF000F000F000F000))
+#define COLUMNS_2(x) ((((x) >> 8) & (uint64_t) 0x00FF00FF00FF00FF) | (((x) << 8) & (uint64_t) 0xFF00FF00FF00FF00))
+#define COLUMNS_3(x) ((((x) >> 12) & (uint64_t) 0x000F000F000F000F) | (((x) << 4) & (uint64_t) 0xFFF0FFF0FFF0FFF0))
+
+/* on a state whose rows are still to be shifted `k` times, the next row is taken `k` columns further */
+#define MIX_COLUMNS(k, k2) \
+static void mix_columns_##k(word *q) \
+{ \
+	word q0, q1, q2, q3, q4, q5, q6, q7; \
+	word r0, r1, r2, r3, r4, r5, r6, r7; \
+	q0 = q[0]; \
+	q1 = q[1]; \
+	q2 = q[2]; \
+	q3 = q[3]; \
+	q4 = q[4]; \
+	q5 = q[5]; \
+	q6 = q[6]; \
+	q7 = q[7]; \
+	r0 = COLUMNS_##k(ROTR16(q0)); \
+	r1 = COLUMNS_##k(ROTR16(q1)); \
+	r2 = COLUMNS_##k(ROTR16(q2)); \
+	r3 = COLUMNS_##k(ROTR16(q3)); \
+	r4 = COLUMNS_##k(ROTR16(q4)); \
+	r5 = COLUMNS_##k(ROTR16(q5)); \
+	r6 = COLUMNS_##k(ROTR16(q6)); \
+	r7 = COLUMNS_##k(ROTR16(q7)); \
+	q[0] = q7 ^ r7 ^ r0 ^ COLUMNS_##k2(ROTR32(q0 ^ r0)); \
+	q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ COLUMNS_##k2(ROTR32(q1 ^ r1)); \
+	q[2] = q1 ^ r1 ^ r2 ^ COLUMNS_##k2(ROTR32(q2 ^ r2)); \
+	q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ COLUMNS_##k2(ROTR32(q3 ^ r3)); \
+	q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ COLUMNS_##k2(ROTR32(q4 ^ r4)); \
+	q[5] = q4 ^ r4 ^ r5 ^ COLUMNS_##k2(ROTR32(q5 ^ r5)); \
+	q[6] = q5 ^ r5 ^ r6 ^ COLUMNS_##k2(ROTR32(q6 ^ r6)); \
+	q[7] = q6 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q7 ^ r7)); \
+} \
+static void inv_mix_columns_##k(word *q) \
+{ \
+	word q0, q1, q2, q3, q4, q5, q6, q7; \
+	word r0, r1, r2, r3, r4, r5, r6, r7; \
+	q0 = q[0]; \
+	q1 = q[1]; \
+	q2 = q[2]; \
+	q3 = q[3]; \
+	q4 = q[4]; \
+	q5 = q[5]; \
+	q6 = q[6]; \
+	q7 = q[7]; \
+	r0 = COLUMNS_##k(ROTR16(q0)); \
+	r1 = COLUMNS_##k(ROTR16(q1)); \
+	r2 = COLUMNS_##k(ROTR16(q2)); \
+	r3 = COLUMNS_##k(ROTR16(q3)); \
+	r4 = COLUMNS_##k(ROTR16(q4)); \
+	r5 = COLUMNS_##k(ROTR16(q5)); \
+	r6 = COLUMNS_##k(ROTR16(q6)); \
+	r7 = COLUMNS_##k(ROTR16(q7)); \
+	q[0] = q5 ^ q6 ^ q7 ^ r0 ^ r5 ^ r7 ^ COLUMNS_##k2(ROTR32(q0 ^ q5 ^ q6 ^ r0 ^ r5)); \
+	q[1] = q0 ^ q5 ^ r0 ^ r1 ^ r5 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q1 ^ q5 ^ q7 ^ r1 ^ r5 ^ r6)); \
+	q[2] = q0 ^ q1 ^ q6 ^ r1 ^ r2 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q0 ^ q2 ^ q6 ^ r2 ^ r6 ^ r7)); \
+	q[3] = q0 ^ q1 ^ q2 ^ q5 ^ q6 ^ r0 ^ r2 ^ r3 ^ r5 \
+		^ COLUMNS_##k2(ROTR32(q0 ^ q1 ^ q3 ^ q5 ^ q6 ^ q7 ^ r0 ^ r3 ^ r5 ^ r7)); \
+	q[4] = q1 ^ q2 ^ q3 ^ q5 ^ r1 ^ r3 ^ r4 ^ r5 ^ r6 ^ r7 \
+		^ COLUMNS_##k2(ROTR32(q1 ^ q2 ^ q4 ^ q5 ^ q7 ^ r1 ^ r4 ^ r5 ^ r6)); \
+	q[5] = q2 ^ q3 ^ q4 ^ q6 ^ r2 ^ r4 ^ r5 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q2 ^ q3 ^ q5 ^ q6 ^ r2 ^ r5 ^ r6 ^ r7)); \
+	q[6] = q3 ^ q4 ^ q5 ^ q7 ^ r3 ^ r5 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q3 ^ q4 ^ q6 ^ q7 ^ r3 ^ r6 ^ r7)); \
+	q[7] = q4 ^ q5 ^ q6 ^ r4 ^ r6 ^ r7 ^ COLUMNS_##k2(ROTR32(q4 ^ q5 ^ q7 ^ r4 ^ r7)); \
+}
+
+/* the row two further is taken twice as many columns further */
+MIX_COLUMNS(0, 0)
+MIX_COLUMNS(1, 2)
+MIX_COLUMNS(2, 0)
+MIX_COLUMNS(3, 2)
+
+static void mix_columns(word *q, unsigned k)
+{
+	switch (k % 4) {
+	case 0:
+		mix_columns_0(q);
+		break;
+	case 1:
+		mix_columns_1(q);
+		break;
+	case 2:
+		mix_columns_2(q);
+		break;
+	default:
+		mix_columns_3(q);
+	}
+}
+
+static void inv_mix_columns(word *q, unsigned k)
+{
+	switch (k % 4) {
+	case 0:
+		inv_mix_columns_0(q);
+		break;
+	case 1:
+		inv_mix_columns_1(q);
+		break;
+	case 2:
+		inv_mix_columns_2(q);
+		break;
+	default:
+		inv_mix_columns_3(q);
+	}
+}
+
+/*
+ * Fixsliced rounds, after Adomnicai and Peyrin: the rows are not shifted, round `r` works on a state
+ * whose rows are still to be shifted `r % 4` times, and its round key is unshifted as many times.
+ * The shifts left after the last round are applied at the end.
+ */
+static void bitslice_encrypt(unsigned rounds, const uint64_t *skey, word *q)
+{
+	unsigned r;
+	add_round_key(q, skey);
+	for (r = 1; r < rounds; ++r) {
+		bitslice_sbox(q);
+		mix_columns(q, r);
+		add_round_key(q, skey + r * 8);
+	}
+	bitslice_sbox(q);
+	add_round_key(q, skey + rounds * 8);
+	for (r = 0; r < rounds % 4; ++r)
+		shift_rows(q);
+}
+
+static void bitslice_decrypt(unsigned rounds, const uint64_t *skey, word *q)
+{
+	unsigned r;
+	for (r = 0; r < rounds % 4; ++r)
+		inv_shift_rows(q);
+	add_round_key(q, skey + rounds * 8);
+	for (r = rounds - 1; r > 0; --r) {
+		bitslice_inv_sbox(q);
+		add_round_key(q, skey + r * 8);
+		inv_mix_columns(q, r);
+	}
+	bitslice_inv_sbox(q);
+	add_round_key(q, skey);
+}
+
+/* each round key is computed as two words with every fourth bit set, then spread to eight words */
+static void skey_expand(uint64_t *skey, const uint64_t *comp, unsigned n)
+{
+	uint64_t x0, x1, x2, x3;
+	unsigned u, v;
+	for (u = 0, v = 0; u < n; ++u, v += 4) {
+		x0 = comp[u] & (uint64_t) 0x1111111111111111;
+		x1 = (comp[u] & (uint64_t) 0x2222222222222222) >> 1;
+		x2 = (comp[u] & (uint64_t) 0x4444444444444444) >> 2;
+		x3 = (comp[u] & (uint64_t) 0x8888888888888888) >> 3;
+		skey[v] = (x0 << 4) - x0;
+		skey[v + 1] = (x1 << 4) - x1;
+		skey[v + 2] = (x2 << 4) - x2;
+		skey[v + 3] = (x3 << 4) - x3;
+	}
+}
+
+/* the schedule is expanded once here, so that single blocks do not pay for it */
+static void bitslice_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	uint64_t comp[30], s[8 * WIDTH];
+	uint32_t w[60], tmp;
+	word q[8];
+	const unsigned n = key->rounds - 6, total = (key->rounds + 1) * 4;
+	unsigned i, j;
+	uint8_t c = 1;
+	for (i = 0; i < n; ++i)
+		w[i] = load_le(raw + i * 4);
+	tmp = w[n - 1];
+	for (i = n, j = 0; i < total; ++i) {
+		if (j == 0) {
+			tmp = (tmp << 24) | (tmp >> 8);
+			tmp = sub_word(tmp) ^ c;
+			c = (c << 1) ^ (0x1B & -(c >> 7));
+		} else if (n > 6 && j == 4) {
+			tmp = sub_word(tmp);
+		}
+		tmp ^= w[i - n];
+		w[i] = tmp;
+		if (++j == n)
+			j = 0;
+	}
+	for (i = 0, j = 0; i < total; i += 4, j += 2) {
+		interleave_in(&s[0], &s[4 * WIDTH], w + i);
+		q[0] = q[1] = q[2] = q[3] = broadcast(s[0]);
+		q[4] = q[5] = q[6] = q[7] = broadcast(s[4 * WIDTH]);
+		ortho(q);
+		memcpy(s, q, sizeof(q));
+		comp[j] = (s[0] & (uint64_t) 0x1111111111111111)
+			| (s[1 * WIDTH] & (uint64_t) 0x2222222222222222)
+			| (s[2 * WIDTH] & (uint64_t) 0x4444444444444444)
+			| (s[3 * WIDTH] & (uint64_t) 0x8888888888888888);
+		comp[j + 1] = (s[4 * WIDTH] & (uint64_t) 0x1111111111111111)
+			| (s[5 * WIDTH] & (uint64_t) 0x2222222222222222)
+			| (s[6 * WIDTH] & (uint64_t) 0x4444444444444444)
+			| (s[7 * WIDTH] & (uint64_t) 0x8888888888888888);
+	}
+	skey_expand(key->key_bitsliced, comp, j);
+	/* the key of round `r` is unshifted `r % 4` times, as the fixsliced state is */
+	for (i = 1; i <= key->rounds; ++i) {
+		for (j = 0; j < 8; ++j)
+			q[j] = broadcast(key->key_bitsliced[i * 8 + j]);
+		for (j = 0; j < i % 4; ++j)
+			inv_shift_rows(q);
+		memcpy(s, q, sizeof(q));
+		for (j = 0; j < 8; ++j)
+			key->key_bitsliced[i * 8 + j] = s[j * WIDTH];
+	}
+}
+
+/* runs up to `LANES` blocks through the cipher, unused lanes are zero */
+static void bitslice_blocks(const struct vial_aes_key *key, int decrypt, uint8_t *dst, const uint8_t *src,
+	size_t nblocks)
+{
+	uint64_t s[8 * WIDTH];
+	word q[8];
+	uint32_t w[LANES * 4] = {0};
+	unsigned i, g;
+	for (i = 0; i < nblocks * 4; ++i)
+		w[i] = load_le(src + i * 4);
+	/* block `i` of group `g` goes to lane `g` of words `i` and `i + 4` */
+	for (g = 0; g < WIDTH; ++g)
+		for (i = 0; i < 4; ++i)
+			interleave_in(&s[i * WIDTH + g], &s[(i + 4) * WIDTH + g], w + (g * 4 + i) * 4);
+	memcpy(q, s, sizeof(q));
+	ortho(q);
+	if (decrypt)
+		bitslice_decrypt(key->rounds, key->key_bitsliced, q);
+	else
+		bitslice_encrypt(key->rounds, key->key_bitsliced, q);
+	ortho(q);
+	memcpy(s, q, sizeof(q));
+	for (g = 0; g < WIDTH; ++g)
+		for (i = 0; i < 4; ++i)
+			interleave_out(w + (g * 4 + i) * 4, s[i * WIDTH + g], s[(i + 4) * WIDTH + g]);
+	for (i = 0; i < nblocks * 4; ++i)
+		store_le(dst + i * 4, w[i]);
+}
+
+static void bitslice_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	size_t n;
+	for (; nblocks > 0; nblocks -= n, src += n * VIAL_AES_BLOCK_SIZE, dst += n * VIAL_AES_BLOCK_SIZE) {
+		n = nblocks < LANES ? nblocks : LANES;
+		bitslice_blocks(key, 0, dst, src, n);
+	}
+}
+
+static void bitslice_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	size_t n;
+	for (; nblocks > 0; nblocks -= n, src += n * VIAL_AES_BLOCK_SIZE, dst += n * VIAL_AES_BLOCK_SIZE) {
+		n = nblocks < LANES ? nblocks : LANES;
+		bitslice_blocks(key, 1, dst, src, n);
+	}
+}
+
+/* a single block only fills the first lane, the others are left zero without interleaving them */
+static void bitslice_block(const struct vial_aes_key *key, int decrypt, uint8_t *dst, const uint8_t *src)
+{
+	uint64_t s[8 * WIDTH] = {0};
+	word q[8];
+	uint32_t w[4];
+	unsigned i;
+	for (i = 0; i < 4; ++i)
+		w[i] = load_le(src + i * 4);
+	interleave_in(&s[0], &s[4 * WIDTH], w);
+	memcpy(q, s, sizeof(q));
+	ortho(q);
+	if (decrypt)
+		bitslice_decrypt(key->rounds, key->key_bitsliced, q);
+	else
+		bitslice_encrypt(key->rounds, key->key_bitsliced, q);
+	ortho(q);
+	memcpy(s, q, sizeof(q));
+	interleave_out(w, s[0], s[4 * WIDTH]);
+	for (i = 0; i < 4; ++i)
+		store_le(dst + i * 4, w[i]);
+}
+
+static void bitslice_encrypt_block(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	bitslice_block(key, 0, dst, src);
+}
+
+static void bitslice_decrypt_block(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	bitslice_block(key, 1, dst, src);
+}
+
+static const struct vial_aes_impl bitslice_impl = {
+	VIAL_AES_BACKEND_BITSLICE,
+	bitslice_key_init,
+	bitslice_encrypt_block,
+	bitslice_decrypt_block,
+	bitslice_blocks_encrypt,
+	bitslice_blocks_decrypt,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+const struct vial_aes_impl *vial_aes_impl_bitslice(void)
+{
+	return &bitslice_impl;
+}
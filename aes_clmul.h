@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* GHASH helpers shared by the x86 backends using carry-less multiplication.
+Not part of the public API. */
+
+#ifndef VIAL_CRYPTO_AES_CLMUL_H
+#define VIAL_CRYPTO_AES_CLMUL_H
+
+#include "aes_impl.h"
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+/* a backend using AVX defines this before inclusion, so that the helpers are VEX encoded */
+#ifndef CLMUL_TARGET
+#define CLMUL_TARGET VIAL_AES_TARGET("pclmul,ssse3")
+#endif
+
+/* GHASH works on byte-reversed blocks, where carry-less multiplication
+gives the bit-reflected product shifted right by one */
+
+static CLMUL_TARGET __m128i ghash_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+	__m128i t0, t1, t2;
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+	/* shift the 256-bit product left by one */
+	t0 = _mm_srli_epi32(lo, 31);
+	t1 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t2 = _mm_srli_si128(t0, 12);
+	t1 = _mm_slli_si128(t1, 4);
+	t0 = _mm_slli_si128(t0, 4);
+	lo = _mm_or_si128(lo, t0);
+	hi = _mm_or_si128(_mm_or_si128(hi, t1), t2);
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t0 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+	t1 = _mm_srli_si128(t0, 4);
+	lo = _mm_xor_si128(lo, _mm_slli_si128(t0, 12));
+	t2 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+	lo = _mm_xor_si128(lo, _mm_xor_si128(t2, t1));
+	return _mm_xor_si128(hi, lo);
+}
+
+static CLMUL_TARGET __m128i ghash_mult(__m128i a, __m128i b)
+{
+	return ghash_reduce(_mm_clmulepi64_si128(a, b, 0x00),
+		_mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01), _mm_clmulepi64_si128(a, b, 0x10)),
+		_mm_clmulepi64_si128(a, b, 0x11));
+}
+
+static CLMUL_TARGET __m128i bswap128(__m128i x)
+{
+	return _mm_shuffle_epi8(x, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+/* stores H^8, ..., H^1 so that the powers line up with 8 consecutive blocks */
+static CLMUL_TARGET void clmul_ghash_init(struct vial_aes_block *pow, const uint8_t *hash_key)
+{
+	__m128i h = bswap128(_mm_loadu_si128((const __m128i *) hash_key)), x = h;
+	unsigned i;
+	_mm_storeu_si128((__m128i *) &pow[7], h);
+	for (i = 7; i --> 0;) {
+		x = ghash_mult(x, h);
+		_mm_storeu_si128((__m128i *) &pow[i], x);
+	}
+}
+
+#endif
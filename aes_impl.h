@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Interface between the modes of operation and the block cipher backends.
+Not part of the public API. */
+
+#ifndef VIAL_CRYPTO_AES_IMPL_H
+#define VIAL_CRYPTO_AES_IMPL_H
+
+#include "aes.h"
+
+#if !defined(VIAL_AES_PORTABLE) && (defined(__GNUC__) || defined(_MSC_VER))
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VIAL_AES_X86 1
+#elif defined(__aarch64__) && defined(__GNUC__) && !defined(__AARCH64EB__)
+#define VIAL_AES_ARM64 1
+#endif
+#endif
+
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define VIAL_AES_TARGET(t) __attribute__((target(t)))
+#else
+#define VIAL_AES_TARGET(t)
+#endif
+
+#define VIAL_AES_CPU_AESNI 0x01U
+#define VIAL_AES_CPU_SSSE3 0x02U
+#define VIAL_AES_CPU_PCLMUL 0x04U
+/** VAES and VPCLMULQDQ on 256-bit registers, with AVX2 enabled by the OS */
+#define VIAL_AES_CPU_VAES 0x08U
+#define VIAL_AES_CPU_ARMV8_AES 0x10U
+#define VIAL_AES_CPU_PMULL 0x20U
+
+/**
+ * Returns the `VIAL_AES_CPU_*` features of the CPU
+ */
+unsigned vial_aes_cpu_features(void);
+
+/**
+ * Block cipher backend, selected when a key is expanded
+ */
+struct vial_aes_impl {
+	enum vial_aes_backend backend;
+	/**
+	 * Expands the key, `key->rounds` is already set.
+	 * May replace `key->impl` with a variant specialised for the number of rounds.
+	 */
+	void (*key_init)(struct vial_aes_key *key, const uint8_t *raw);
+	void (*encrypt)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src);
+	void (*decrypt)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src);
+	/** Processes independent blocks, `dst` may equal `src` */
+	void (*blocks_encrypt)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+	void (*blocks_decrypt)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+	/**
+	 * Encrypts `nblocks` consecutive values of the big-endian 128-bit `counter` and xors them with `src`,
+	 * then advances the counter. Only the low `bits` bits (32, 64 or 128) are incremented.
+	 * Optional, `blocks_encrypt` is used if NULL.
+	 */
+	void (*ctr_blocks)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+		uint8_t *counter, unsigned bits);
+	/**
+	 * Precomputes `pow` from the GCM hash key, for `ghash_blocks`.
+	 * Optional together with `ghash_blocks`, the portable GHASH is used if NULL.
+	 */
+	void (*ghash_init)(struct vial_aes_block *pow, const uint8_t *hash_key);
+	/** Absorbs `nblocks` blocks into the GHASH accumulator `acc`, stored in the byte order of the input */
+	void (*ghash_blocks)(const struct vial_aes_block *pow, struct vial_aes_block *acc, const uint8_t *src,
+		size_t nblocks);
+	/**
+	 * GCM encryption or decryption of `nblocks` blocks in one pass: `ctr_blocks` with a 32-bit counter
+	 * followed by `ghash_blocks` of the ciphertext, with the AES rounds interleaved with the multiplications.
+	 * Optional, used only together with `ghash_blocks`.
+	 */
+	void (*gcm_blocks)(const struct vial_aes_key *key, const struct vial_aes_block *pow, struct vial_aes_block *acc,
+		uint8_t *dst, const uint8_t *src, size_t nblocks, uint8_t *counter, int decrypt);
+	/**
+	 * CBC decryption of `nblocks` blocks, where `iv` is the previous ciphertext block and is updated.
+	 * `dst` may equal `src`. Optional, `blocks_decrypt` is used if NULL.
+	 */
+	void (*cbc_decrypt_blocks)(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+		uint8_t *iv);
+	/**
+	 * Encrypts one block for each of up to `VIAL_AES_LANES` lanes, each lane with its own key.
+	 * The keys have the same number of rounds. Optional, single block encryption is used if NULL.
+	 */
+	void (*lanes_encrypt)(const struct vial_aes_key *const *keys, struct vial_aes_block *blocks, unsigned nlanes);
+	/**
+	 * EAX encryption or decryption of `nblocks` blocks in one pass: `ctr_blocks` with the CBC-MAC of the
+	 * ciphertext, each block of the serial MAC chain encrypted together with the next counter block.
+	 * `mac` holds a pending block which is encrypted before the first ciphertext block is xored in,
+	 * the last ciphertext block is left pending.
+	 * The independent chain `hmac` of `hblocks` header blocks is advanced in the same way alongside, if not NULL.
+	 * Optional.
+	 */
+	void (*eax_blocks)(const struct vial_aes_key *key, struct vial_aes_block *mac, uint8_t *dst, const uint8_t *src,
+		size_t nblocks, uint8_t *counter, unsigned bits, int decrypt, struct vial_aes_block *hmac,
+		const uint8_t *hsrc, size_t hblocks);
+};
+
+/**
+ * Returns the AES-NI backend, or NULL if not supported by the CPU or the build
+ */
+const struct vial_aes_impl *vial_aes_impl_aesni(void);
+
+/**
+ * Returns the VAES/VPCLMULQDQ backend, or NULL if not supported by the CPU or the build
+ */
+const struct vial_aes_impl *vial_aes_impl_vaes(void);
+
+/**
+ * Returns the ARMv8 Cryptographic Extension backend, or NULL if not supported by the CPU or the build
+ */
+const struct vial_aes_impl *vial_aes_impl_armv8(void);
+
+/**
+ * Returns the T-table backend, or NULL unless the build defines `VIAL_AES_TTABLE`
+ */
+const struct vial_aes_impl *vial_aes_impl_ttable(void);
+
+/**
+ * Returns the SSSE3 vector permute backend, or NULL if not supported by the CPU or the build
+ */
+const struct vial_aes_impl *vial_aes_impl_vpaes(void);
+
+/**
+ * Returns the bitsliced backend
+ */
+const struct vial_aes_impl *vial_aes_impl_bitslice(void);
+
+static inline uint64_t vial_aes_load_be64(const uint8_t *src)
+{
+	uint64_t x = 0;
+	unsigned i;
+	for (i = 0; i < 8; ++i)
+		x = (x << 8) | src[i];
+	return x;
+}
+
+static inline void vial_aes_store_be64(uint8_t *dst, uint64_t x)
+{
+	unsigned i;
+	for (i = 8; i --> 0; x >>= 8)
+		dst[i] = (uint8_t) x;
+}
+
+/* CTR counters are handled as two native halves, the low `bits` bits of which are incremented */
+
+#define VIAL_AES_COUNTER_MASK(bits) ((bits) == 32 ? (uint64_t) 0xFFFFFFFFU : UINT64_MAX)
+
+/**
+ * Returns whether `n` consecutive counters starting from `lo` can be computed without carrying
+ * out of the low half or the counter width, e.g. by adding to vector lanes
+ */
+static inline int vial_aes_counter_fits(uint64_t lo, uint64_t n, unsigned bits)
+{
+	return (lo & VIAL_AES_COUNTER_MASK(bits)) <= VIAL_AES_COUNTER_MASK(bits) - (n - 1);
+}
+
+/**
+ * Adds `n` to the counter, modulo 2 to the power of `bits`
+ */
+static inline void vial_aes_counter_add(uint64_t *hi, uint64_t *lo, uint64_t n, unsigned bits)
+{
+	const uint64_t mask = VIAL_AES_COUNTER_MASK(bits);
+	*lo = (*lo & ~mask) | ((*lo + n) & mask);
+	if (bits == 128 && *lo < n)
+		++*hi;
+}
+
+/* bytes processed by one thread at a time, small enough to stay in its cache */
+#define VIAL_AES_PARALLEL_CHUNK (64 * 1024)
+/* number of chunks run at once when a result has to be kept for each of them */
+#define VIAL_AES_PARALLEL_ROUND 256
+
+/**
+ * Calls `fn(arg, chunk)` for each chunk index below `nchunks`, on the threads of the pool and the calling thread.
+ * Runs them all on the calling thread if `pool` is NULL.
+ */
+void vial_aes_pool_run(struct vial_aes_pool *pool, void (*fn)(void *arg, size_t chunk), void *arg, size_t nchunks);
+
+#if VIAL_AES_X86
+/* AES-NI primitives shared with the wider backends */
+void vial_aes_aesni_key_init(struct vial_aes_key *key, const uint8_t *raw);
+void vial_aes_aesni_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src);
+void vial_aes_aesni_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src);
+void vial_aes_aesni_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+void vial_aes_aesni_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks);
+void vial_aes_aesni_ctr_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+	uint8_t *counter, unsigned bits);
+void vial_aes_aesni_lanes_encrypt(const struct vial_aes_key *const *keys, struct vial_aes_block *blocks, unsigned nlanes);
+void vial_aes_aesni_cbc_decrypt_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+	uint8_t *iv);
+void vial_aes_aesni_eax_blocks(const struct vial_aes_key *key, struct vial_aes_block *mac, uint8_t *dst,
+	const uint8_t *src, size_t nblocks, uint8_t *counter, unsigned bits, int decrypt, struct vial_aes_block *hmac,
+	const uint8_t *hsrc, size_t hblocks);
+#endif
+
+#endif
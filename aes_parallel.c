@@ -0,0 +1,385 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Pool of threads which split large messages into chunks that fit in the cache.
+Idle threads take the next chunk from a shared index, so faster threads do more of them. */
+
+#include "aes_impl.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VIAL_AES_NO_THREADS)
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define CHUNK_BLOCKS (VIAL_AES_PARALLEL_CHUNK / VIAL_AES_BLOCK_SIZE)
+
+#ifndef VIAL_AES_NO_THREADS
+
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define THREAD_FN DWORD WINAPI
+#define mutex_init(m) (InitializeCriticalSection(m), 0)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) (InitializeConditionVariable(c), 0)
+#define cond_destroy(c) ((void) (c))
+#define cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define THREAD_FN void *
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init(c, NULL)
+#define cond_destroy(c) pthread_cond_destroy(c)
+#define cond_wait(c, m) pthread_cond_wait(c, m)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+struct vial_aes_pool {
+	mutex_t lock;
+	cond_t work, done;
+	void (*fn)(void *arg, size_t chunk);
+	void *arg;
+	size_t next, nchunks, finished;
+	unsigned long generation;
+	int busy, stop;
+	unsigned nworkers;
+	thread_t workers[];
+};
+
+static unsigned cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned) n : 1;
+#else
+	return 1;
+#endif
+}
+
+/* takes chunks until none are left, called and returning with the lock held */
+static void run_chunks(struct vial_aes_pool *pool)
+{
+	void (*fn)(void *, size_t) = pool->fn;
+	void *arg = pool->arg;
+	size_t i;
+	while (pool->next < pool->nchunks) {
+		i = pool->next++;
+		mutex_unlock(&pool->lock);
+		fn(arg, i);
+		mutex_lock(&pool->lock);
+		if (++pool->finished == pool->nchunks)
+			cond_broadcast(&pool->done);
+	}
+}
+
+static THREAD_FN worker(void *p)
+{
+	struct vial_aes_pool *pool = p;
+	unsigned long seen = 0;
+	mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stop && pool->generation == seen)
+			cond_wait(&pool->work, &pool->lock);
+		if (pool->stop)
+			break;
+		seen = pool->generation;
+		run_chunks(pool);
+	}
+	mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static int thread_create(thread_t *thread, struct vial_aes_pool *pool)
+{
+#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, worker, pool, 0, NULL);
+	return *thread == NULL;
+#else
+	return pthread_create(thread, NULL, worker, pool);
+#endif
+}
+
+static void thread_join(thread_t thread)
+{
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+enum vial_aes_error vial_aes_pool_create(struct vial_aes_pool **pool, unsigned nthreads)
+{
+	struct vial_aes_pool *self;
+	if (nthreads == 0)
+		nthreads = cpu_count();
+	/* the calling thread takes chunks as well */
+	self = malloc(sizeof(*self) + (nthreads - 1) * sizeof(thread_t));
+	if (self == NULL)
+		return VIAL_AES_ERROR_THREADS;
+	memset(self, 0, sizeof(*self));
+	if (mutex_init(&self->lock)) {
+		free(self);
+		return VIAL_AES_ERROR_THREADS;
+	}
+	if (cond_init(&self->work) || cond_init(&self->done)) {
+		mutex_destroy(&self->lock);
+		free(self);
+		return VIAL_AES_ERROR_THREADS;
+	}
+	for (; self->nworkers < nthreads - 1; ++self->nworkers) {
+		if (thread_create(&self->workers[self->nworkers], self)) {
+			vial_aes_pool_destroy(self);
+			return VIAL_AES_ERROR_THREADS;
+		}
+	}
+	*pool = self;
+	return VIAL_AES_ERROR_NONE;
+}
+
+void vial_aes_pool_destroy(struct vial_aes_pool *pool)
+{
+	unsigned i;
+	if (pool == NULL)
+		return;
+	mutex_lock(&pool->lock);
+	pool->stop = 1;
+	cond_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nworkers; ++i)
+		thread_join(pool->workers[i]);
+	cond_destroy(&pool->work);
+	cond_destroy(&pool->done);
+	mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void vial_aes_pool_run(struct vial_aes_pool *pool, void (*fn)(void *arg, size_t chunk), void *arg, size_t nchunks)
+{
+	size_t i;
+	if (pool == NULL || pool->nworkers == 0 || nchunks < 2) {
+		for (i = 0; i < nchunks; ++i)
+			fn(arg, i);
+		return;
+	}
+	mutex_lock(&pool->lock);
+	/* one message at a time, other callers wait for the pool */
+	while (pool->busy)
+		cond_wait(&pool->done, &pool->lock);
+	pool->busy = 1;
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->next = 0;
+	pool->nchunks = nchunks;
+	pool->finished = 0;
+	++pool->generation;
+	cond_broadcast(&pool->work);
+	run_chunks(pool);
+	while (pool->finished < pool->nchunks)
+		cond_wait(&pool->done, &pool->lock);
+	pool->busy = 0;
+	cond_broadcast(&pool->done);
+	mutex_unlock(&pool->lock);
+}
+
+#else
+
+struct vial_aes_pool {
+	int unused;
+};
+
+enum vial_aes_error vial_aes_pool_create(struct vial_aes_pool **pool, unsigned nthreads)
+{
+	(void) pool;
+	(void) nthreads;
+	return VIAL_AES_ERROR_THREADS;
+}
+
+void vial_aes_pool_destroy(struct vial_aes_pool *pool)
+{
+	(void) pool;
+}
+
+void vial_aes_pool_run(struct vial_aes_pool *pool, void (*fn)(void *arg, size_t chunk), void *arg, size_t nchunks)
+{
+	size_t i;
+	(void) pool;
+	for (i = 0; i < nchunks; ++i)
+		fn(arg, i);
+}
+
+#endif
+
+static size_t chunk_count(size_t nblocks)
+{
+	return (nblocks + CHUNK_BLOCKS - 1) / CHUNK_BLOCKS;
+}
+
+static size_t chunk_blocks(size_t nblocks, size_t chunk)
+{
+	return nblocks - chunk * CHUNK_BLOCKS < CHUNK_BLOCKS ? nblocks - chunk * CHUNK_BLOCKS : CHUNK_BLOCKS;
+}
+
+struct ctr_job {
+	const struct vial_aes_ctr *ctr;
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t nblocks;
+};
+
+static void ctr_chunk(void *arg, size_t chunk)
+{
+	const struct ctr_job *job = arg;
+	const size_t offset = chunk * VIAL_AES_PARALLEL_CHUNK;
+	struct vial_aes_ctr ctr = *job->ctr;
+	uint64_t hi = vial_aes_load_be64((const uint8_t *) &ctr.counter);
+	uint64_t lo = vial_aes_load_be64((const uint8_t *) &ctr.counter + 8);
+	vial_aes_counter_add(&hi, &lo, chunk * CHUNK_BLOCKS, ctr.counter_bits);
+	vial_aes_store_be64((uint8_t *) &ctr.counter, hi);
+	vial_aes_store_be64((uint8_t *) &ctr.counter + 8, lo);
+	vial_aes_ctr_crypt(&ctr, job->dst + offset, job->src + offset,
+		chunk_blocks(job->nblocks, chunk) * VIAL_AES_BLOCK_SIZE);
+}
+
+enum vial_aes_error vial_aes_ctr_crypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ctr *self,
+	uint8_t *dst, const uint8_t *src, size_t len)
+{
+	struct ctr_job job;
+	uint64_t hi, lo;
+	size_t n = VIAL_AES_BLOCK_SIZE - self->pad_used;
+	/* finish the keystream block left by the previous call */
+	if (n > len)
+		n = len;
+	vial_aes_ctr_crypt(self, dst, src, n);
+	len -= n;
+	src += n;
+	dst += n;
+	job.ctr = self;
+	job.dst = dst;
+	job.src = src;
+	job.nblocks = len / VIAL_AES_BLOCK_SIZE;
+	vial_aes_pool_run(pool, ctr_chunk, &job, chunk_count(job.nblocks));
+	hi = vial_aes_load_be64((const uint8_t *) &self->counter);
+	lo = vial_aes_load_be64((const uint8_t *) &self->counter + 8);
+	vial_aes_counter_add(&hi, &lo, job.nblocks, self->counter_bits);
+	vial_aes_store_be64((uint8_t *) &self->counter, hi);
+	vial_aes_store_be64((uint8_t *) &self->counter + 8, lo);
+	n = job.nblocks * VIAL_AES_BLOCK_SIZE;
+	return vial_aes_ctr_crypt(self, dst + n, src + n, len - n);
+}
+
+struct ecb_job {
+	const struct vial_aes_key *key;
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t nblocks;
+	int decrypt;
+};
+
+static void ecb_chunk(void *arg, size_t chunk)
+{
+	const struct ecb_job *job = arg;
+	const size_t offset = chunk * VIAL_AES_PARALLEL_CHUNK;
+	if (job->decrypt)
+		vial_aes_blocks_decrypt(job->key, job->dst + offset, job->src + offset, chunk_blocks(job->nblocks, chunk));
+	else
+		vial_aes_blocks_encrypt(job->key, job->dst + offset, job->src + offset, chunk_blocks(job->nblocks, chunk));
+}
+
+static enum vial_aes_error ecb_parallel(struct vial_aes_pool *pool, struct vial_aes_ecb *self, uint8_t *dst,
+	const uint8_t *src, size_t len, int decrypt)
+{
+	struct ecb_job job;
+	if (len % VIAL_AES_BLOCK_SIZE != 0)
+		return VIAL_AES_ERROR_LENGTH;
+	job.key = self->key;
+	job.dst = dst;
+	job.src = src;
+	job.nblocks = len / VIAL_AES_BLOCK_SIZE;
+	job.decrypt = decrypt;
+	vial_aes_pool_run(pool, ecb_chunk, &job, chunk_count(job.nblocks));
+	return VIAL_AES_ERROR_NONE;
+}
+
+enum vial_aes_error vial_aes_ecb_encrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ecb *self,
+	uint8_t *dst, const uint8_t *src, size_t len)
+{
+	return ecb_parallel(pool, self, dst, src, len, 0);
+}
+
+enum vial_aes_error vial_aes_ecb_decrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_ecb *self,
+	uint8_t *dst, const uint8_t *src, size_t len)
+{
+	return ecb_parallel(pool, self, dst, src, len, 1);
+}
+
+struct cbc_job {
+	const struct vial_aes_cbc *cbc;
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t nblocks;
+	struct vial_aes_block ivs[VIAL_AES_PARALLEL_ROUND];
+};
+
+static void cbc_chunk(void *arg, size_t chunk)
+{
+	const struct cbc_job *job = arg;
+	const size_t offset = chunk * VIAL_AES_PARALLEL_CHUNK;
+	struct vial_aes_cbc cbc = *job->cbc;
+	cbc.iv = job->ivs[chunk];
+	vial_aes_cbc_decrypt(&cbc, job->dst + offset, job->src + offset,
+		chunk_blocks(job->nblocks, chunk) * VIAL_AES_BLOCK_SIZE);
+}
+
+enum vial_aes_error vial_aes_cbc_decrypt_parallel(struct vial_aes_pool *pool, struct vial_aes_cbc *self,
+	uint8_t *dst, const uint8_t *src, size_t len)
+{
+	struct cbc_job job;
+	size_t nblocks, nchunks, i;
+	if (len % VIAL_AES_BLOCK_SIZE != 0)
+		return VIAL_AES_ERROR_LENGTH;
+	job.cbc = self;
+	for (; len > 0; len -= nblocks * VIAL_AES_BLOCK_SIZE) {
+		nblocks = len / VIAL_AES_BLOCK_SIZE;
+		if (nblocks > VIAL_AES_PARALLEL_ROUND * CHUNK_BLOCKS)
+			nblocks = VIAL_AES_PARALLEL_ROUND * CHUNK_BLOCKS;
+		nchunks = chunk_count(nblocks);
+		/* the ciphertext preceding each chunk may be overwritten by another thread when decrypting in place */
+		job.ivs[0] = self->iv;
+		for (i = 1; i < nchunks; ++i)
+			memcpy(&job.ivs[i], src + i * VIAL_AES_PARALLEL_CHUNK - VIAL_AES_BLOCK_SIZE, VIAL_AES_BLOCK_SIZE);
+		memcpy(&self->iv, src + (nblocks - 1) * VIAL_AES_BLOCK_SIZE, VIAL_AES_BLOCK_SIZE);
+		job.dst = dst;
+		job.src = src;
+		job.nblocks = nblocks;
+		vial_aes_pool_run(pool, cbc_chunk, &job, nchunks);
+		src += nblocks * VIAL_AES_BLOCK_SIZE;
+		dst += nblocks * VIAL_AES_BLOCK_SIZE;
+	}
+	return VIAL_AES_ERROR_NONE;
+}
@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Chunked streams sealed with GCM or EAX, following the STREAM construction of Hoang, Reyhanitabar,
+Rogaway and Vizar. Every chunk is sealed on its own, so the threads of a pool take whole chunks. */
+
+#include "aes_impl.h"
+
+#include <string.h>
+
+#define VERSION 2
+#define TAG_SIZE VIAL_AES_BLOCK_SIZE
+/* 7 zero bytes, the index of the chunk and the flag of the last chunk, which GCM takes without hashing */
+#define CHUNK_NONCE_SIZE 12
+/* chunks are counted in 32 bits */
+#define MAX_CHUNKS ((uint64_t) 1 << 32)
+#define SALT_OFFSET 8
+
+static const uint8_t magic[4] = {'V', 'I', 'A', 'L'};
+/* the terminating zero byte separates the label from the context */
+static const char label[] = "VIAL stream key";
+
+/* derives the key of the stream from the master key and the header, with the counter mode KDF of SP 800-108 */
+static enum vial_aes_error derive_key(struct vial_aes_stream *self, const struct vial_aes_key *key)
+{
+	const unsigned keybits = (key->rounds - 6) * 32;
+	uint8_t input[1 + sizeof(label) + VIAL_AES_STREAM_HEADER_SIZE + 2];
+	uint8_t derived[2 * VIAL_AES_BLOCK_SIZE];
+	enum vial_aes_error err;
+	memcpy(input + 1, label, sizeof(label));
+	memcpy(input + 1 + sizeof(label), self->header, VIAL_AES_STREAM_HEADER_SIZE);
+	input[sizeof(input) - 2] = (uint8_t) (keybits >> 8);
+	input[sizeof(input) - 1] = (uint8_t) keybits;
+	for (unsigned i = 0; i * 128 < keybits; ++i) {
+		input[0] = (uint8_t) (i + 1);
+		vial_aes_cmac_tag(key, derived + i * VIAL_AES_BLOCK_SIZE, VIAL_AES_BLOCK_SIZE, input, sizeof(input));
+	}
+	if (self->mode == VIAL_AES_MODE_GCM)
+		err = vial_aes_gcm_key_init_backend(&self->key.gcm, vial_aes_key_backend(key), keybits, derived);
+	else
+		err = vial_aes_eax_key_init_backend(&self->key.eax, vial_aes_key_backend(key), keybits, derived);
+	memset(derived, 0, sizeof(derived));
+	return err;
+}
+
+enum vial_aes_error vial_aes_stream_init(struct vial_aes_stream *self, const struct vial_aes_key *key,
+	enum vial_aes_mode mode, unsigned chunk_bits, const uint8_t *salt)
+{
+	if (mode != VIAL_AES_MODE_GCM && mode != VIAL_AES_MODE_EAX)
+		return VIAL_AES_ERROR_CIPHER;
+	if (chunk_bits < VIAL_AES_STREAM_MIN_BITS || chunk_bits > VIAL_AES_STREAM_MAX_BITS)
+		return VIAL_AES_ERROR_LENGTH;
+	self->mode = mode;
+	self->chunk_size = (size_t) 1 << chunk_bits;
+	/* magic, version, mode, chunk size, a reserved byte and the salt */
+	memcpy(self->header, magic, sizeof(magic));
+	self->header[4] = VERSION;
+	self->header[5] = (uint8_t) mode;
+	self->header[6] = (uint8_t) chunk_bits;
+	self->header[7] = 0;
+	memcpy(self->header + SALT_OFFSET, salt, VIAL_AES_STREAM_SALT_SIZE);
+	return derive_key(self, key);
+}
+
+enum vial_aes_error vial_aes_stream_init_header(struct vial_aes_stream *self, const struct vial_aes_key *key,
+	const uint8_t *header)
+{
+	enum vial_aes_error err;
+	if (memcmp(header, magic, sizeof(magic)) || header[4] != VERSION || header[7])
+		return VIAL_AES_ERROR_IV;
+	err = vial_aes_stream_init(self, key, (enum vial_aes_mode) header[5], header[6], header + SALT_OFFSET);
+	return err == VIAL_AES_ERROR_LENGTH ? VIAL_AES_ERROR_IV : err;
+}
+
+uint64_t vial_aes_stream_chunk_offset(const struct vial_aes_stream *self, uint64_t index)
+{
+	return VIAL_AES_STREAM_HEADER_SIZE + index * (self->chunk_size + TAG_SIZE);
+}
+
+uint64_t vial_aes_stream_size(const struct vial_aes_stream *self, uint64_t len)
+{
+	/* an empty message still has its last chunk */
+	uint64_t nchunks = len == 0 ? 1 : (len + self->chunk_size - 1) / self->chunk_size;
+	return VIAL_AES_STREAM_HEADER_SIZE + len + nchunks * TAG_SIZE;
+}
+
+/* number of sealed chunks in `len` bytes ending with the last chunk, 0 if there is no such number */
+static uint64_t last_chunks(const struct vial_aes_stream *self, uint64_t len)
+{
+	const uint64_t sealed = self->chunk_size + TAG_SIZE;
+	uint64_t nchunks = (len + sealed - 1) / sealed;
+	if (len < TAG_SIZE || len - (nchunks - 1) * sealed < TAG_SIZE)
+		return 0;
+	return nchunks;
+}
+
+enum vial_aes_error vial_aes_stream_message_size(const struct vial_aes_stream *self, uint64_t size, uint64_t *len)
+{
+	uint64_t nchunks;
+	if (size < VIAL_AES_STREAM_HEADER_SIZE)
+		return VIAL_AES_ERROR_LENGTH;
+	size -= VIAL_AES_STREAM_HEADER_SIZE;
+	nchunks = last_chunks(self, size);
+	if (nchunks == 0 || nchunks > MAX_CHUNKS)
+		return VIAL_AES_ERROR_LENGTH;
+	*len = size - nchunks * TAG_SIZE;
+	return VIAL_AES_ERROR_NONE;
+}
+
+struct stream_job {
+	const struct vial_aes_stream *stream;
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t len;
+	uint64_t index;
+	size_t nchunks, chunks_per_task, first_task;
+	int last, open;
+	enum vial_aes_error status[VIAL_AES_PARALLEL_ROUND];
+};
+
+/* seals or opens chunk `chunk` of the job, counted from its first one */
+static enum vial_aes_error stream_chunk(const struct stream_job *job, size_t chunk)
+{
+	const struct vial_aes_stream *self = job->stream;
+	const size_t sealed = self->chunk_size + TAG_SIZE;
+	const uint64_t index = job->index + chunk;
+	uint8_t nonce[CHUNK_NONCE_SIZE] = {0};
+	uint8_t *dst;
+	const uint8_t *src;
+	size_t len;
+	nonce[7] = (uint8_t) (index >> 24);
+	nonce[8] = (uint8_t) (index >> 16);
+	nonce[9] = (uint8_t) (index >> 8);
+	nonce[10] = (uint8_t) index;
+	nonce[11] = job->last && chunk == job->nchunks - 1;
+	if (job->open) {
+		dst = job->dst + chunk * self->chunk_size;
+		src = job->src + chunk * sealed;
+		len = chunk == job->nchunks - 1 ? job->len - chunk * sealed : sealed;
+		if (self->mode == VIAL_AES_MODE_GCM)
+			return vial_aes_gcm_open(&self->key.gcm, nonce, sizeof(nonce), self->header, sizeof(self->header),
+				dst, src, len);
+		return vial_aes_eax_open(&self->key.eax, nonce, sizeof(nonce), self->header, sizeof(self->header),
+			dst, src, len);
+	}
+	dst = job->dst + chunk * sealed;
+	src = job->src + chunk * self->chunk_size;
+	len = chunk == job->nchunks - 1 ? job->len - chunk * self->chunk_size : self->chunk_size;
+	if (self->mode == VIAL_AES_MODE_GCM)
+		return vial_aes_gcm_seal(&self->key.gcm, nonce, sizeof(nonce), self->header, sizeof(self->header),
+			dst, src, len);
+	return vial_aes_eax_seal(&self->key.eax, nonce, sizeof(nonce), self->header, sizeof(self->header),
+		dst, src, len);
+}
+
+/* small chunks are grouped so that a thread takes about as much work at once as in the other parallel functions */
+static void stream_task(void *arg, size_t task)
+{
+	struct stream_job *job = arg;
+	size_t chunk = (job->first_task + task) * job->chunks_per_task;
+	size_t end = chunk + job->chunks_per_task < job->nchunks ? chunk + job->chunks_per_task : job->nchunks;
+	enum vial_aes_error err;
+	job->status[task] = VIAL_AES_ERROR_NONE;
+	for (; chunk < end; ++chunk) {
+		err = stream_chunk(job, chunk);
+		if (err)
+			job->status[task] = err;
+	}
+}
+
+static enum vial_aes_error stream_run(struct vial_aes_pool *pool, const struct vial_aes_stream *self,
+	uint64_t index, int last, uint8_t *dst, const uint8_t *src, size_t len, int open)
+{
+	struct stream_job job;
+	enum vial_aes_error err = VIAL_AES_ERROR_NONE;
+	const size_t unit = open ? self->chunk_size + TAG_SIZE : self->chunk_size;
+	size_t ntasks, n, i;
+	if (!last && (len == 0 || len % unit != 0))
+		return VIAL_AES_ERROR_LENGTH;
+	if (!last)
+		job.nchunks = len / unit;
+	else if (open)
+		job.nchunks = (size_t) last_chunks(self, len);
+	else
+		job.nchunks = len == 0 ? 1 : (len + unit - 1) / unit;
+	if (job.nchunks == 0 || index > MAX_CHUNKS || job.nchunks > MAX_CHUNKS - index)
+		return VIAL_AES_ERROR_LENGTH;
+	job.stream = self;
+	job.dst = dst;
+	job.src = src;
+	job.len = len;
+	job.index = index;
+	job.last = last;
+	job.open = open;
+	job.chunks_per_task = self->chunk_size < VIAL_AES_PARALLEL_CHUNK ? VIAL_AES_PARALLEL_CHUNK / self->chunk_size : 1;
+	ntasks = (job.nchunks + job.chunks_per_task - 1) / job.chunks_per_task;
+	for (job.first_task = 0; job.first_task < ntasks; job.first_task += n) {
+		n = ntasks - job.first_task;
+		if (n > VIAL_AES_PARALLEL_ROUND)
+			n = VIAL_AES_PARALLEL_ROUND;
+		vial_aes_pool_run(pool, stream_task, &job, n);
+		for (i = 0; i < n; ++i) {
+			if (!err)
+				err = job.status[i];
+		}
+	}
+	return err;
+}
+
+enum vial_aes_error vial_aes_stream_seal(struct vial_aes_pool *pool, const struct vial_aes_stream *self,
+	uint64_t index, int last, uint8_t *dst, const uint8_t *src, size_t len)
+{
+	return stream_run(pool, self, index, last, dst, src, len, 0);
+}
+
+enum vial_aes_error vial_aes_stream_open(struct vial_aes_pool *pool, const struct vial_aes_stream *self,
+	uint64_t index, int last, uint8_t *dst, const uint8_t *src, size_t len)
+{
+	return stream_run(pool, self, index, last, dst, src, len, 1);
+}
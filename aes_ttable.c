@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Classic 32-bit table implementation, combining SubBytes, ShiftRows and MixColumns into four lookups
+per column. The lookup addresses depend on the key and data, so it leaks through cache timing:
+it is only compiled when VIAL_AES_TTABLE is defined, for deployments where that is acceptable. */
+
+#include "aes_impl.h"
+
+#ifdef VIAL_AES_TTABLE
+
+#include <string.h>
+
+#define SBOX(X) \
+	X(0x63) X(0x7c) X(0x77) X(0x7b) X(0xf2) X(0x6b) X(0x6f) X(0xc5) \
+	X(0x30) X(0x01) X(0x67) X(0x2b) X(0xfe) X(0xd7) X(0xab) X(0x76) \
+	X(0xca) X(0x82) X(0xc9) X(0x7d) X(0xfa) X(0x59) X(0x47) X(0xf0) \
+	X(0xad) X(0xd4) X(0xa2) X(0xaf) X(0x9c) X(0xa4) X(0x72) X(0xc0) \
+	X(0xb7) X(0xfd) X(0x93) X(0x26) X(0x36) X(0x3f) X(0xf7) X(0xcc) \
+	X(0x34) X(0xa5) X(0xe5) X(0xf1) X(0x71) X(0xd8) X(0x31) X(0x15) \
+	X(0x04) X(0xc7) X(0x23) X(0xc3) X(0x18) X(0x96) X(0x05) X(0x9a) \
+	X(0x07) X(0x12) X(0x80) X(0xe2) X(0xeb) X(0x27) X(0xb2) X(0x75) \
+	X(0x09) X(0x83) X(0x2c) X(0x1a) X(0x1b) X(0x6e) X(0x5a) X(0xa0) \
+	X(0x52) X(0x3b) X(0xd6) X(0xb3) X(0x29) X(0xe3) X(0x2f) X(0x84) \
+	X(0x53) X(0xd1) X(0x00) X(0xed) X(0x20) X(0xfc) X(0xb1) X(0x5b) \
+	X(0x6a) X(0xcb) X(0xbe) X(0x39) X(0x4a) X(0x4c) X(0x58) X(0xcf) \
+	X(0xd0) X(0xef) X(0xaa) X(0xfb) X(0x43) X(0x4d) X(0x33) X(0x85) \
+	X(0x45) X(0xf9) X(0x02) X(0x7f) X(0x50) X(0x3c) X(0x9f) X(0xa8) \
+	X(0x51) X(0xa3) X(0x40) X(0x8f) X(0x92) X(0x9d) X(0x38) X(0xf5) \
+	X(0xbc) X(0xb6) X(0xda) X(0x21) X(0x10) X(0xff) X(0xf3) X(0xd2) \
+	X(0xcd) X(0x0c) X(0x13) X(0xec) X(0x5f) X(0x97) X(0x44) X(0x17) \
+	X(0xc4) X(0xa7) X(0x7e) X(0x3d) X(0x64) X(0x5d) X(0x19) X(0x73) \
+	X(0x60) X(0x81) X(0x4f) X(0xdc) X(0x22) X(0x2a) X(0x90) X(0x88) \
+	X(0x46) X(0xee) X(0xb8) X(0x14) X(0xde) X(0x5e) X(0x0b) X(0xdb) \
+	X(0xe0) X(0x32) X(0x3a) X(0x0a) X(0x49) X(0x06) X(0x24) X(0x5c) \
+	X(0xc2) X(0xd3) X(0xac) X(0x62) X(0x91) X(0x95) X(0xe4) X(0x79) \
+	X(0xe7) X(0xc8) X(0x37) X(0x6d) X(0x8d) X(0xd5) X(0x4e) X(0xa9) \
+	X(0x6c) X(0x56) X(0xf4) X(0xea) X(0x65) X(0x7a) X(0xae) X(0x08) \
+	X(0xba) X(0x78) X(0x25) X(0x2e) X(0x1c) X(0xa6) X(0xb4) X(0xc6) \
+	X(0xe8) X(0xdd) X(0x74) X(0x1f) X(0x4b) X(0xbd) X(0x8b) X(0x8a) \
+	X(0x70) X(0x3e) X(0xb5) X(0x66) X(0x48) X(0x03) X(0xf6) X(0x0e) \
+	X(0x61) X(0x35) X(0x57) X(0xb9) X(0x86) X(0xc1) X(0x1d) X(0x9e) \
+	X(0xe1) X(0xf8) X(0x98) X(0x11) X(0x69) X(0xd9) X(0x8e) X(0x94) \
+	X(0x9b) X(0x1e) X(0x87) X(0xe9) X(0xce) X(0x55) X(0x28) X(0xdf) \
+	X(0x8c) X(0xa1) X(0x89) X(0x0d) X(0xbf) X(0xe6) X(0x42) X(0x68) \
+	X(0x41) X(0x99) X(0x2d) X(0x0f) X(0xb0) X(0x54) X(0xbb) X(0x16)
+
+#define RSBOX(X) \
+	X(0x52) X(0x09) X(0x6a) X(0xd5) X(0x30) X(0x36) X(0xa5) X(0x38) \
+	X(0xbf) X(0x40) X(0xa3) X(0x9e) X(0x81) X(0xf3) X(0xd7) X(0xfb) \
+	X(0x7c) X(0xe3) X(0x39) X(0x82) X(0x9b) X(0x2f) X(0xff) X(0x87) \
+	X(0x34) X(0x8e) X(0x43) X(0x44) X(0xc4) X(0xde) X(0xe9) X(0xcb) \
+	X(0x54) X(0x7b) X(0x94) X(0x32) X(0xa6) X(0xc2) X(0x23) X(0x3d) \
+	X(0xee) X(0x4c) X(0x95) X(0x0b) X(0x42) X(0xfa) X(0xc3) X(0x4e) \
+	X(0x08) X(0x2e) X(0xa1) X(0x66) X(0x28) X(0xd9) X(0x24) X(0xb2) \
+	X(0x76) X(0x5b) X(0xa2) X(0x49) X(0x6d) X(0x8b) X(0xd1) X(0x25) \
+	X(0x72) X(0xf8) X(0xf6) X(0x64) X(0x86) X(0x68) X(0x98) X(0x16) \
+	X(0xd4) X(0xa4) X(0x5c) X(0xcc) X(0x5d) X(0x65) X(0xb6) X(0x92) \
+	X(0x6c) X(0x70) X(0x48) X(0x50) X(0xfd) X(0xed) X(0xb9) X(0xda) \
+	X(0x5e) X(0x15) X(0x46) X(0x57) X(0xa7) X(0x8d) X(0x9d) X(0x84) \
+	X(0x90) X(0xd8) X(0xab) X(0x00) X(0x8c) X(0xbc) X(0xd3) X(0x0a) \
+	X(0xf7) X(0xe4) X(0x58) X(0x05) X(0xb8) X(0xb3) X(0x45) X(0x06) \
+	X(0xd0) X(0x2c) X(0x1e) X(0x8f) X(0xca) X(0x3f) X(0x0f) X(0x02) \
+	X(0xc1) X(0xaf) X(0xbd) X(0x03) X(0x01) X(0x13) X(0x8a) X(0x6b) \
+	X(0x3a) X(0x91) X(0x11) X(0x41) X(0x4f) X(0x67) X(0xdc) X(0xea) \
+	X(0x97) X(0xf2) X(0xcf) X(0xce) X(0xf0) X(0xb4) X(0xe6) X(0x73) \
+	X(0x96) X(0xac) X(0x74) X(0x22) X(0xe7) X(0xad) X(0x35) X(0x85) \
+	X(0xe2) X(0xf9) X(0x37) X(0xe8) X(0x1c) X(0x75) X(0xdf) X(0x6e) \
+	X(0x47) X(0xf1) X(0x1a) X(0x71) X(0x1d) X(0x29) X(0xc5) X(0x89) \
+	X(0x6f) X(0xb7) X(0x62) X(0x0e) X(0xaa) X(0x18) X(0xbe) X(0x1b) \
+	X(0xfc) X(0x56) X(0x3e) X(0x4b) X(0xc6) X(0xd2) X(0x79) X(0x20) \
+	X(0x9a) X(0xdb) X(0xc0) X(0xfe) X(0x78) X(0xcd) X(0x5a) X(0xf4) \
+	X(0x1f) X(0xdd) X(0xa8) X(0x33) X(0x88) X(0x07) X(0xc7) X(0x31) \
+	X(0xb1) X(0x12) X(0x10) X(0x59) X(0x27) X(0x80) X(0xec) X(0x5f) \
+	X(0x60) X(0x51) X(0x7f) X(0xa9) X(0x19) X(0xb5) X(0x4a) X(0x0d) \
+	X(0x2d) X(0xe5) X(0x7a) X(0x9f) X(0x93) X(0xc9) X(0x9c) X(0xef) \
+	X(0xa0) X(0xe0) X(0x3b) X(0x4d) X(0xae) X(0x2a) X(0xf5) X(0xb0) \
+	X(0xc8) X(0xeb) X(0xbb) X(0x3c) X(0x83) X(0x53) X(0x99) X(0x61) \
+	X(0x17) X(0x2b) X(0x04) X(0x7e) X(0xba) X(0x77) X(0xd6) X(0x26) \
+	X(0xe1) X(0x69) X(0x14) X(0x63) X(0x55) X(0x21) X(0x0c) X(0x7d)
+
+/* multiplication in GF(2^8), as constant expressions */
+#define XT(x) ((((x) << 1) ^ (((x) >> 7) * 0x1B)) & 0xFF)
+#define M2(x) XT(x)
+#define M3(x) (XT(x) ^ (x))
+#define M9(x) (XT(XT(XT(x))) ^ (x))
+#define MB(x) (XT(XT(XT(x))) ^ XT(x) ^ (x))
+#define MD(x) (XT(XT(XT(x))) ^ XT(XT(x)) ^ (x))
+#define ME(x) (XT(XT(XT(x))) ^ XT(XT(x)) ^ XT(x))
+
+#define WORD(a, b, c, d) ((uint32_t) (a) << 24 | (uint32_t) (b) << 16 | (uint32_t) (c) << 8 | (uint32_t) (d))
+
+#define TE0(s) WORD(M2(s), s, s, M3(s)),
+#define TE1(s) WORD(M3(s), M2(s), s, s),
+#define TE2(s) WORD(s, M3(s), M2(s), s),
+#define TE3(s) WORD(s, s, M3(s), M2(s)),
+#define TD0(s) WORD(ME(s), M9(s), MD(s), MB(s)),
+#define TD1(s) WORD(MB(s), ME(s), M9(s), MD(s)),
+#define TD2(s) WORD(MD(s), MB(s), ME(s), M9(s)),
+#define TD3(s) WORD(M9(s), MD(s), MB(s), ME(s)),
+#define BYTE(s) s,
+
+static const uint32_t te0[256] = { SBOX(TE0) };
+static const uint32_t te1[256] = { SBOX(TE1) };
+static const uint32_t te2[256] = { SBOX(TE2) };
+static const uint32_t te3[256] = { SBOX(TE3) };
+static const uint32_t td0[256] = { RSBOX(TD0) };
+static const uint32_t td1[256] = { RSBOX(TD1) };
+static const uint32_t td2[256] = { RSBOX(TD2) };
+static const uint32_t td3[256] = { RSBOX(TD3) };
+static const uint8_t td4[256] = { RSBOX(BYTE) };
+
+#define B0(x) ((x) >> 24)
+#define B1(x) (((x) >> 16) & 0xFF)
+#define B2(x) (((x) >> 8) & 0xFF)
+#define B3(x) ((x) & 0xFF)
+
+/* te2 holds the plain S-box in its top byte */
+#define SUB(x) (te2[x] >> 24)
+
+static uint32_t load_be32(const uint8_t *src)
+{
+	return WORD(src[0], src[1], src[2], src[3]);
+}
+
+static void store_be32(uint8_t *dst, uint32_t x)
+{
+	dst[0] = x >> 24;
+	dst[1] = x >> 16;
+	dst[2] = x >> 8;
+	dst[3] = x;
+}
+
+/* round keys are stored as big-endian column words, the decryption ones for the equivalent inverse cipher */
+static void ttable_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	const unsigned nk = key->rounds - 6, nw = 4 * (key->rounds + 1);
+	uint32_t *w = key->key_exp[0].words, *d = key->key_dec[0].words, t, rcon = 1;
+	unsigned i, r;
+	for (i = 0; i < nk; ++i)
+		w[i] = load_be32(raw + 4 * i);
+	for (; i < nw; ++i) {
+		t = w[i - 1];
+		if (i % nk == 0) {
+			t = WORD(SUB(B1(t)) ^ rcon, SUB(B2(t)), SUB(B3(t)), SUB(B0(t)));
+			rcon = XT(rcon);
+		} else if (nk == 8 && i % nk == 4) {
+			t = WORD(SUB(B0(t)), SUB(B1(t)), SUB(B2(t)), SUB(B3(t)));
+		}
+		w[i] = w[i - nk] ^ t;
+	}
+	for (r = 0; r <= key->rounds; ++r) {
+		for (i = 0; i < 4; ++i) {
+			t = w[4 * (key->rounds - r) + i];
+			if (r > 0 && r < key->rounds)
+				t = td0[SUB(B0(t))] ^ td1[SUB(B1(t))] ^ td2[SUB(B2(t))] ^ td3[SUB(B3(t))];
+			d[4 * r + i] = t;
+		}
+	}
+}
+
+static void ttable_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	const uint32_t *rk = key->key_exp[0].words;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+	unsigned r;
+	s0 = load_be32(src) ^ rk[0];
+	s1 = load_be32(src + 4) ^ rk[1];
+	s2 = load_be32(src + 8) ^ rk[2];
+	s3 = load_be32(src + 12) ^ rk[3];
+	for (r = 1; r < key->rounds; ++r) {
+		rk += 4;
+		t0 = te0[B0(s0)] ^ te1[B1(s1)] ^ te2[B2(s2)] ^ te3[B3(s3)] ^ rk[0];
+		t1 = te0[B0(s1)] ^ te1[B1(s2)] ^ te2[B2(s3)] ^ te3[B3(s0)] ^ rk[1];
+		t2 = te0[B0(s2)] ^ te1[B1(s3)] ^ te2[B2(s0)] ^ te3[B3(s1)] ^ rk[2];
+		t3 = te0[B0(s3)] ^ te1[B1(s0)] ^ te2[B2(s1)] ^ te3[B3(s2)] ^ rk[3];
+		s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+	}
+	rk += 4;
+	store_be32(dst, WORD(SUB(B0(s0)), SUB(B1(s1)), SUB(B2(s2)), SUB(B3(s3))) ^ rk[0]);
+	store_be32(dst + 4, WORD(SUB(B0(s1)), SUB(B1(s2)), SUB(B2(s3)), SUB(B3(s0))) ^ rk[1]);
+	store_be32(dst + 8, WORD(SUB(B0(s2)), SUB(B1(s3)), SUB(B2(s0)), SUB(B3(s1))) ^ rk[2]);
+	store_be32(dst + 12, WORD(SUB(B0(s3)), SUB(B1(s0)), SUB(B2(s1)), SUB(B3(s2))) ^ rk[3]);
+}
+
+static void ttable_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	const uint32_t *dk = key->key_dec[0].words;
+	uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+	unsigned r;
+	s0 = load_be32(src) ^ dk[0];
+	s1 = load_be32(src + 4) ^ dk[1];
+	s2 = load_be32(src + 8) ^ dk[2];
+	s3 = load_be32(src + 12) ^ dk[3];
+	for (r = 1; r < key->rounds; ++r) {
+		dk += 4;
+		t0 = td0[B0(s0)] ^ td1[B1(s3)] ^ td2[B2(s2)] ^ td3[B3(s1)] ^ dk[0];
+		t1 = td0[B0(s1)] ^ td1[B1(s0)] ^ td2[B2(s3)] ^ td3[B3(s2)] ^ dk[1];
+		t2 = td0[B0(s2)] ^ td1[B1(s1)] ^ td2[B2(s0)] ^ td3[B3(s3)] ^ dk[2];
+		t3 = td0[B0(s3)] ^ td1[B1(s2)] ^ td2[B2(s1)] ^ td3[B3(s0)] ^ dk[3];
+		s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+	}
+	dk += 4;
+	store_be32(dst, WORD(td4[B0(s0)], td4[B1(s3)], td4[B2(s2)], td4[B3(s1)]) ^ dk[0]);
+	store_be32(dst + 4, WORD(td4[B0(s1)], td4[B1(s0)], td4[B2(s3)], td4[B3(s2)]) ^ dk[1]);
+	store_be32(dst + 8, WORD(td4[B0(s2)], td4[B1(s1)], td4[B2(s0)], td4[B3(s3)]) ^ dk[2]);
+	store_be32(dst + 12, WORD(td4[B0(s3)], td4[B1(s2)], td4[B2(s1)], td4[B3(s0)]) ^ dk[3]);
+}
+
+static void ttable_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	for (; nblocks > 0; --nblocks, src += VIAL_AES_BLOCK_SIZE, dst += VIAL_AES_BLOCK_SIZE)
+		ttable_encrypt(key, dst, src);
+}
+
+static void ttable_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	for (; nblocks > 0; --nblocks, src += VIAL_AES_BLOCK_SIZE, dst += VIAL_AES_BLOCK_SIZE)
+		ttable_decrypt(key, dst, src);
+}
+
+static const struct vial_aes_impl ttable_impl = {
+	VIAL_AES_BACKEND_TTABLE,
+	ttable_key_init,
+	ttable_encrypt,
+	ttable_decrypt,
+	ttable_blocks_encrypt,
+	ttable_blocks_decrypt,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+const struct vial_aes_impl *vial_aes_impl_ttable(void)
+{
+	return &ttable_impl;
+}
+
+#else
+
+const struct vial_aes_impl *vial_aes_impl_ttable(void)
+{
+	return NULL;
+}
+
+#endif
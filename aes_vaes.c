@@ -0,0 +1,276 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* VAES and VPCLMULQDQ operate on two blocks per 256-bit register.
+The 512-bit forms are not used, so that CPUs without AVX-512 benefit as well
+and CPUs with it do not lower their clock speed. */
+
+#include "aes_impl.h"
+
+#if VIAL_AES_X86
+
+#include <immintrin.h>
+
+#define VAES_TARGET VIAL_AES_TARGET("avx2,vaes,vpclmulqdq,aes,pclmul")
+/* avoids transitions between SSE and AVX code */
+#define CLMUL_TARGET VAES_TARGET
+
+#include "aes_clmul.h"
+
+#define RK(key, i) _mm_loadu_si128((const __m128i *) &(key)->key_exp[i])
+#define RK2(key, i) _mm256_broadcastsi128_si256(RK(key, i))
+#define DK2(key, i) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) &(key)->key_dec[i]))
+
+/* The upper halves are cleared explicitly before returning or calling the SSE code of the AES-NI backend:
+the compiler does not on every path, and the next SSE instruction would then wait for a state transition. */
+
+/* number of blocks in flight, in 8 registers */
+#define WIDE_BLOCKS 16
+
+#define LOAD8(p) \
+	b0 = _mm256_loadu_si256((const __m256i *) (p)); \
+	b1 = _mm256_loadu_si256((const __m256i *) (p) + 1); \
+	b2 = _mm256_loadu_si256((const __m256i *) (p) + 2); \
+	b3 = _mm256_loadu_si256((const __m256i *) (p) + 3); \
+	b4 = _mm256_loadu_si256((const __m256i *) (p) + 4); \
+	b5 = _mm256_loadu_si256((const __m256i *) (p) + 5); \
+	b6 = _mm256_loadu_si256((const __m256i *) (p) + 6); \
+	b7 = _mm256_loadu_si256((const __m256i *) (p) + 7)
+
+#define STORE8(p) \
+	_mm256_storeu_si256((__m256i *) (p), b0); \
+	_mm256_storeu_si256((__m256i *) (p) + 1, b1); \
+	_mm256_storeu_si256((__m256i *) (p) + 2, b2); \
+	_mm256_storeu_si256((__m256i *) (p) + 3, b3); \
+	_mm256_storeu_si256((__m256i *) (p) + 4, b4); \
+	_mm256_storeu_si256((__m256i *) (p) + 5, b5); \
+	_mm256_storeu_si256((__m256i *) (p) + 6, b6); \
+	_mm256_storeu_si256((__m256i *) (p) + 7, b7)
+
+#define APPLY8(f, k) \
+	b0 = f(b0, k); \
+	b1 = f(b1, k); \
+	b2 = f(b2, k); \
+	b3 = f(b3, k); \
+	b4 = f(b4, k); \
+	b5 = f(b5, k); \
+	b6 = f(b6, k); \
+	b7 = f(b7, k)
+
+#define ENCRYPT8(key) do { \
+	unsigned r; \
+	__m256i k = RK2(key, 0); \
+	APPLY8(_mm256_xor_si256, k); \
+	for (r = 1; r < (key)->rounds; ++r) { \
+		k = RK2(key, r); \
+		APPLY8(_mm256_aesenc_epi128, k); \
+	} \
+	k = RK2(key, (key)->rounds); \
+	APPLY8(_mm256_aesenclast_epi128, k); \
+} while (0)
+
+#define DECRYPT8(key) do { \
+	unsigned r; \
+	__m256i k = DK2(key, 0); \
+	APPLY8(_mm256_xor_si256, k); \
+	for (r = 1; r < (key)->rounds; ++r) { \
+		k = DK2(key, r); \
+		APPLY8(_mm256_aesdec_epi128, k); \
+	} \
+	k = DK2(key, (key)->rounds); \
+	APPLY8(_mm256_aesdeclast_epi128, k); \
+} while (0)
+
+static VAES_TARGET void vaes_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	__m256i b0, b1, b2, b3, b4, b5, b6, b7;
+	for (; nblocks >= WIDE_BLOCKS; nblocks -= WIDE_BLOCKS, src += 256, dst += 256) {
+		LOAD8(src);
+		ENCRYPT8(key);
+		STORE8(dst);
+	}
+	_mm256_zeroupper();
+	if (nblocks > 0)
+		vial_aes_aesni_blocks_encrypt(key, dst, src, nblocks);
+}
+
+static VAES_TARGET void vaes_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	__m256i b0, b1, b2, b3, b4, b5, b6, b7;
+	for (; nblocks >= WIDE_BLOCKS; nblocks -= WIDE_BLOCKS, src += 256, dst += 256) {
+		LOAD8(src);
+		DECRYPT8(key);
+		STORE8(dst);
+	}
+	_mm256_zeroupper();
+	if (nblocks > 0)
+		vial_aes_aesni_blocks_decrypt(key, dst, src, nblocks);
+}
+
+/* each register pair is xored with the ciphertext starting one block earlier */
+static VAES_TARGET void vaes_cbc_decrypt_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src,
+	size_t nblocks, uint8_t *iv)
+{
+	__m256i b0, b1, b2, b3, b4, b5, b6, b7;
+	__m128i prev = _mm_loadu_si128((const __m128i *) iv);
+	for (; nblocks >= WIDE_BLOCKS; nblocks -= WIDE_BLOCKS, src += 256, dst += 256) {
+		LOAD8(src);
+		DECRYPT8(key);
+		b0 = _mm256_xor_si256(b0, _mm256_inserti128_si256(_mm256_castsi128_si256(prev),
+			_mm_loadu_si128((const __m128i *) src), 1));
+		b1 = _mm256_xor_si256(b1, _mm256_loadu_si256((const __m256i *) (src + 16)));
+		b2 = _mm256_xor_si256(b2, _mm256_loadu_si256((const __m256i *) (src + 48)));
+		b3 = _mm256_xor_si256(b3, _mm256_loadu_si256((const __m256i *) (src + 80)));
+		b4 = _mm256_xor_si256(b4, _mm256_loadu_si256((const __m256i *) (src + 112)));
+		b5 = _mm256_xor_si256(b5, _mm256_loadu_si256((const __m256i *) (src + 144)));
+		b6 = _mm256_xor_si256(b6, _mm256_loadu_si256((const __m256i *) (src + 176)));
+		b7 = _mm256_xor_si256(b7, _mm256_loadu_si256((const __m256i *) (src + 208)));
+		prev = _mm_loadu_si128((const __m128i *) (src + 240));
+		STORE8(dst);
+	}
+	_mm_storeu_si128((__m128i *) iv, prev);
+	_mm256_zeroupper();
+	if (nblocks > 0)
+		vial_aes_aesni_cbc_decrypt_blocks(key, dst, src, nblocks, iv);
+}
+
+static VAES_TARGET void vaes_ctr_blocks(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks,
+	uint8_t *counter, unsigned bits)
+{
+	/* the counters are kept as little-endian 128-bit integers and byte swapped for encryption */
+	const __m256i bswap = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256i two = _mm256_set_epi64x(0, 2, 0, 2);
+	__m256i b0, b1, b2, b3, b4, b5, b6, b7, c;
+	uint64_t hi = vial_aes_load_be64(counter), lo = vial_aes_load_be64(counter + 8);
+	uint8_t buf[WIDE_BLOCKS * VIAL_AES_BLOCK_SIZE], *p;
+	size_t i;
+	for (; nblocks >= WIDE_BLOCKS; nblocks -= WIDE_BLOCKS, src += 256, dst += 256) {
+		if (vial_aes_counter_fits(lo, WIDE_BLOCKS, bits)) {
+			c = _mm256_set_epi64x((long long) hi, (long long) (lo + 1), (long long) hi, (long long) lo);
+			b0 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b1 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b2 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b3 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b4 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b5 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b6 = _mm256_shuffle_epi8(c, bswap); c = _mm256_add_epi64(c, two);
+			b7 = _mm256_shuffle_epi8(c, bswap);
+			vial_aes_counter_add(&hi, &lo, WIDE_BLOCKS, bits);
+		} else {
+			for (i = 0, p = buf; i < WIDE_BLOCKS; ++i, p += VIAL_AES_BLOCK_SIZE) {
+				vial_aes_store_be64(p, hi);
+				vial_aes_store_be64(p + 8, lo);
+				vial_aes_counter_add(&hi, &lo, 1, bits);
+			}
+			LOAD8(buf);
+		}
+		ENCRYPT8(key);
+		b0 = _mm256_xor_si256(b0, _mm256_loadu_si256((const __m256i *) src));
+		b1 = _mm256_xor_si256(b1, _mm256_loadu_si256((const __m256i *) src + 1));
+		b2 = _mm256_xor_si256(b2, _mm256_loadu_si256((const __m256i *) src + 2));
+		b3 = _mm256_xor_si256(b3, _mm256_loadu_si256((const __m256i *) src + 3));
+		b4 = _mm256_xor_si256(b4, _mm256_loadu_si256((const __m256i *) src + 4));
+		b5 = _mm256_xor_si256(b5, _mm256_loadu_si256((const __m256i *) src + 5));
+		b6 = _mm256_xor_si256(b6, _mm256_loadu_si256((const __m256i *) src + 6));
+		b7 = _mm256_xor_si256(b7, _mm256_loadu_si256((const __m256i *) src + 7));
+		STORE8(dst);
+	}
+	vial_aes_store_be64(counter, hi);
+	vial_aes_store_be64(counter + 8, lo);
+	_mm256_zeroupper();
+	/* a partial wide batch would cost as much as a whole one */
+	if (nblocks > 0)
+		vial_aes_aesni_ctr_blocks(key, dst, src, nblocks, counter, bits);
+}
+
+static VAES_TARGET __m128i fold(__m256i x)
+{
+	return _mm_xor_si128(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+}
+
+#define GHASH_MULT(d, k) \
+	lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(d, k, 0x00)); \
+	mid = _mm256_xor_si256(mid, _mm256_clmulepi64_epi128(d, k, 0x01)); \
+	mid = _mm256_xor_si256(mid, _mm256_clmulepi64_epi128(d, k, 0x10)); \
+	hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(d, k, 0x11))
+
+/* 8 blocks are multiplied by descending powers of H and reduced once */
+static VAES_TARGET void vaes_ghash_blocks(const struct vial_aes_block *pow, struct vial_aes_block *acc, const uint8_t *src,
+	size_t nblocks)
+{
+	const __m256i bswap = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m256i k0 = _mm256_loadu_si256((const __m256i *) pow);
+	const __m256i k1 = _mm256_loadu_si256((const __m256i *) pow + 1);
+	const __m256i k2 = _mm256_loadu_si256((const __m256i *) pow + 2);
+	const __m256i k3 = _mm256_loadu_si256((const __m256i *) pow + 3);
+	__m128i x = bswap128(_mm_loadu_si128((const __m128i *) acc));
+	__m256i d, lo, mid, hi;
+	for (; nblocks >= 8; nblocks -= 8, src += 128) {
+		d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) src), bswap);
+		d = _mm256_xor_si256(d, _mm256_zextsi128_si256(x));
+		lo = mid = hi = _mm256_setzero_si256();
+		GHASH_MULT(d, k0);
+		d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) src + 1), bswap);
+		GHASH_MULT(d, k1);
+		d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) src + 2), bswap);
+		GHASH_MULT(d, k2);
+		d = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) src + 3), bswap);
+		GHASH_MULT(d, k3);
+		x = ghash_reduce(fold(lo), fold(mid), fold(hi));
+	}
+	if (nblocks > 0) {
+		/* the remaining blocks take the lowest powers, and are still reduced once */
+		__m128i l = _mm_setzero_si128(), m = l, u = l, e, k;
+		for (size_t i = 0; i < nblocks; ++i, src += 16) {
+			e = bswap128(_mm_loadu_si128((const __m128i *) src));
+			if (i == 0)
+				e = _mm_xor_si128(e, x);
+			k = _mm_loadu_si128((const __m128i *) &pow[8 - nblocks + i]);
+			l = _mm_xor_si128(l, _mm_clmulepi64_si128(e, k, 0x00));
+			m = _mm_xor_si128(m, _mm_clmulepi64_si128(e, k, 0x01));
+			m = _mm_xor_si128(m, _mm_clmulepi64_si128(e, k, 0x10));
+			u = _mm_xor_si128(u, _mm_clmulepi64_si128(e, k, 0x11));
+		}
+		x = ghash_reduce(l, m, u);
+	}
+	_mm_storeu_si128((__m128i *) acc, bswap128(x));
+	_mm256_zeroupper();
+}
+
+static const struct vial_aes_impl vaes_impl = {
+	VIAL_AES_BACKEND_VAES,
+	vial_aes_aesni_key_init,
+	vial_aes_aesni_encrypt,
+	vial_aes_aesni_decrypt,
+	vaes_blocks_encrypt,
+	vaes_blocks_decrypt,
+	vaes_ctr_blocks,
+	clmul_ghash_init,
+	vaes_ghash_blocks,
+	NULL,
+	vaes_cbc_decrypt_blocks,
+	vial_aes_aesni_lanes_encrypt,
+	vial_aes_aesni_eax_blocks
+};
+
+const struct vial_aes_impl *vial_aes_impl_vaes(void)
+{
+	const unsigned required = VIAL_AES_CPU_AESNI | VIAL_AES_CPU_PCLMUL | VIAL_AES_CPU_VAES;
+	return (vial_aes_cpu_features() & required) == required ? &vaes_impl : NULL;
+}
+
+#else
+
+const struct vial_aes_impl *vial_aes_impl_vaes(void)
+{
+	return NULL;
+}
+
+#endif
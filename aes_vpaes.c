@@ -0,0 +1,392 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Constant-time implementation using the SSSE3 byte shuffle (pshufb) as a 16 entry table lookup,
+after "Accelerating AES with Vector Permute Instructions" by Mike Hamburg.
+The state is kept in a basis where the S-box inversion decomposes into inversions in GF(2^4),
+so the only tables are the constants below, indexed by register shuffles and not by memory loads.
+The transforms in and out of that basis are folded into the round keys. */
+
+#include "aes_impl.h"
+
+#if VIAL_AES_X86
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+#define VPAES_TARGET VIAL_AES_TARGET("ssse3")
+
+#define LOAD(t) _mm_loadu_si128((const __m128i *) (t))
+#define RK(key, i) _mm_loadu_si128((const __m128i *) &(key)->key_exp[i])
+#define DK(key, i) _mm_loadu_si128((const __m128i *) &(key)->key_dec[i])
+
+/* GF(2^4) inverse 1/x and a/x, with 1/0 mapped to 0x80 so that a second lookup yields 0 */
+static const uint64_t k_inv[2][2] = {
+	{ 0x0E05060F0D080180, 0x040703090A0B0C02 },
+	{ 0x01040A060F0B0780, 0x030D0E0C02050809 }
+};
+
+/* input transform, indexed by low and high nibble */
+static const uint64_t k_ipt[2][2] = {
+	{ 0xC2B2E8985A2A7000, 0xCABAE09052227808 },
+	{ 0x4C01307D317C4D00, 0xCD80B1FCB0FDCC81 }
+};
+
+/* S-box output, multiplied by 1 and 2 for MixColumns, and for the last round */
+static const uint64_t k_sb1[2][2] = {
+	{ 0xB19BE18FCB503E00, 0xA5DF7A6E142AF544 },
+	{ 0x3618D415FAE22300, 0x3BF7CCC10D2ED9EF }
+};
+static const uint64_t k_sb2[2][2] = {
+	{ 0xE27A93C60B712400, 0x5EB7E955BC982FCD },
+	{ 0x69EB88400AE12900, 0xC2A163C8AB82234A }
+};
+static const uint64_t k_sbo[2][2] = {
+	{ 0xD0D26D176FBDC700, 0x15AABF7AC502A878 },
+	{ 0xCFE474A55FBB6A00, 0x8E1E90D1412B35FA }
+};
+
+/* column rotations for MixColumns, ShiftRows is applied implicitly by rotating these every round */
+static const uint64_t k_mc_forward[4][2] = {
+	{ 0x0407060500030201, 0x0C0F0E0D080B0A09 },
+	{ 0x080B0A0904070605, 0x000302010C0F0E0D },
+	{ 0x0C0F0E0D080B0A09, 0x0407060500030201 },
+	{ 0x000302010C0F0E0D, 0x080B0A0904070605 }
+};
+static const uint64_t k_mc_backward[4][2] = {
+	{ 0x0605040702010003, 0x0E0D0C0F0A09080B },
+	{ 0x020100030E0D0C0F, 0x0A09080B06050407 },
+	{ 0x0E0D0C0F0A09080B, 0x0605040702010003 },
+	{ 0x0A09080B06050407, 0x020100030E0D0C0F }
+};
+
+/* the accumulated ShiftRows permutation after a multiple of four rounds plus the index */
+static const uint64_t k_sr[4][2] = {
+	{ 0x0706050403020100, 0x0F0E0D0C0B0A0908 },
+	{ 0x030E09040F0A0500, 0x0B06010C07020D08 },
+	{ 0x0F060D040B020900, 0x070E050C030A0108 },
+	{ 0x0B0E0104070A0D00, 0x0306090C0F020508 }
+};
+
+/* round constants in the transformed basis, consumed from the top byte */
+static const uint64_t k_rcon[2] = { 0x1F8391B9AF9DEEB6, 0x702A98084D7C7D81 };
+
+/* 0x63 in the transformed basis */
+static const uint64_t k_s63[2] = { 0x5B5B5B5B5B5B5B5B, 0x5B5B5B5B5B5B5B5B };
+
+/* output transform and its variant for the last decryption round key */
+static const uint64_t k_opt[2][2] = {
+	{ 0xFF9F4929D6B66000, 0xF7974121DEBE6808 },
+	{ 0x01EDBD5150BCEC00, 0xE10D5DB1B05C0CE0 }
+};
+static const uint64_t k_deskew[2][2] = {
+	{ 0x07E4A34047A4E300, 0x1DFEB95A5DBEF91A },
+	{ 0x5F36B5DC83EA6900, 0x2841C2ABF49D1E77 }
+};
+
+/* InvMixColumns of the decryption round keys, multiplication by D, B, E (with 0x63) and 9 */
+static const uint64_t k_dks[8][2] = {
+	{ 0xFEB91A5DA3E44700, 0x0740E3A45A1DBEF9 },
+	{ 0x41C277F4B5368300, 0x5FDC69EAAB289D1E },
+	{ 0x9A4FCA1F8550D500, 0x03D653861CC94C99 },
+	{ 0x115BEDA7B6FC4A00, 0xD993256F7E3482C8 },
+	{ 0xD5031CCA1FC9D600, 0x53859A4C994F5086 },
+	{ 0xA23196054FDC7BE8, 0xCD5EF96A20B31487 },
+	{ 0xB6116FC87ED9A700, 0x4AED933482255BFC },
+	{ 0x4576516227143300, 0x8BB89FACE9DAFDCE }
+};
+
+/* decryption input transform */
+static const uint64_t k_dipt[2][2] = {
+	{ 0x0F505B040B545F00, 0x154A411E114E451A },
+	{ 0x86E383E660056500, 0x12771772F491F194 }
+};
+
+/* inverse S-box output, multiplied by 9, D, B, E for InvMixColumns, and for the last round */
+static const uint64_t k_dsb[10][2] = {
+	{ 0x851C03539A86D600, 0xCAD51F504F994CC9 },
+	{ 0xC03B1789ECD74900, 0x725E2C9EB2FBA565 },
+	{ 0x7D57CCDFE6B1A200, 0xF56E9B13882A4439 },
+	{ 0x3CE2FAF724C6CB00, 0x2931180D15DEEFD3 },
+	{ 0xD022649296B44200, 0x602646F6B0F2D404 },
+	{ 0xC19498A6CD596700, 0xF3FF0C3E3255AA6B },
+	{ 0x46F2929626D4D000, 0x2242600464B4F6B0 },
+	{ 0x0C55A6CDFFAAC100, 0x9467F36B98593E32 },
+	{ 0x1387EA537EF94000, 0xC7AA6DB9D4943E2D },
+	{ 0x12D7560F93441D00, 0xCA4B8159D8C58E9C }
+};
+
+static VPAES_TARGET __m128i transform(__m128i x, const uint64_t (*t)[2])
+{
+	const __m128i s0f = _mm_set1_epi8(0x0F);
+	__m128i hi = _mm_srli_epi32(_mm_andnot_si128(s0f, x), 4);
+	x = _mm_and_si128(x, s0f);
+	return _mm_xor_si128(_mm_shuffle_epi8(LOAD(t[0]), x), _mm_shuffle_epi8(LOAD(t[1]), hi));
+}
+
+/* inversion in GF(2^8), leaving two halves to index the S-box output tables */
+static VPAES_TARGET void invert(__m128i x, __m128i *io, __m128i *jo)
+{
+	const __m128i s0f = _mm_set1_epi8(0x0F), inv = LOAD(k_inv[0]);
+	__m128i i, j, k, ak, iak, jak;
+	i = _mm_srli_epi32(_mm_andnot_si128(s0f, x), 4);
+	k = _mm_and_si128(x, s0f);
+	ak = _mm_shuffle_epi8(LOAD(k_inv[1]), k);
+	j = _mm_xor_si128(k, i);
+	iak = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+	jak = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+	*io = _mm_xor_si128(_mm_shuffle_epi8(inv, iak), j);
+	*jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jak), i);
+}
+
+static VPAES_TARGET __m128i sbox_out(const uint64_t (*t)[2], __m128i io, __m128i jo)
+{
+	return _mm_xor_si128(_mm_shuffle_epi8(LOAD(t[0]), io), _mm_shuffle_epi8(LOAD(t[1]), jo));
+}
+
+static VPAES_TARGET __m128i encrypt_core(const struct vial_aes_key *key, __m128i x)
+{
+	__m128i io, jo, a, b, fwd;
+	unsigned r;
+	x = _mm_xor_si128(transform(x, k_ipt), RK(key, 0));
+	for (r = 1; r < key->rounds; ++r) {
+		invert(x, &io, &jo);
+		fwd = LOAD(k_mc_forward[r & 3]);
+		a = _mm_xor_si128(sbox_out(k_sb1, io, jo), RK(key, r));
+		b = _mm_shuffle_epi8(a, fwd);
+		x = _mm_xor_si128(sbox_out(k_sb2, io, jo), b); /* 2A + B */
+		b = _mm_xor_si128(_mm_shuffle_epi8(a, LOAD(k_mc_backward[r & 3])), x); /* 2A + B + D */
+		x = _mm_xor_si128(_mm_shuffle_epi8(x, fwd), b); /* 2A + 3B + C + D */
+	}
+	invert(x, &io, &jo);
+	x = _mm_xor_si128(sbox_out(k_sbo, io, jo), RK(key, key->rounds));
+	return _mm_shuffle_epi8(x, LOAD(k_sr[key->rounds & 3]));
+}
+
+static VPAES_TARGET __m128i decrypt_core(const struct vial_aes_key *key, __m128i x)
+{
+	__m128i io, jo, mc = LOAD(k_mc_forward[3]);
+	unsigned r;
+	x = _mm_xor_si128(transform(x, k_dipt), DK(key, 0));
+	for (r = 1; r < key->rounds; ++r) {
+		invert(x, &io, &jo);
+		x = _mm_xor_si128(sbox_out(k_dsb, io, jo), DK(key, r));
+		x = _mm_xor_si128(_mm_shuffle_epi8(x, mc), sbox_out(k_dsb + 2, io, jo));
+		x = _mm_xor_si128(_mm_shuffle_epi8(x, mc), sbox_out(k_dsb + 4, io, jo));
+		x = _mm_xor_si128(_mm_shuffle_epi8(x, mc), sbox_out(k_dsb + 6, io, jo));
+		mc = _mm_alignr_epi8(mc, mc, 12);
+	}
+	invert(x, &io, &jo);
+	x = _mm_xor_si128(sbox_out(k_dsb + 8, io, jo), DK(key, key->rounds));
+	return _mm_shuffle_epi8(x, LOAD(k_sr[(((key->rounds - 1) << 4) ^ 0x30) >> 4 & 3]));
+}
+
+struct schedule {
+	struct vial_aes_key *key;
+	__m128i prev, rcon;
+	unsigned n, sr;
+	int decrypt;
+};
+
+/* computes the next 4 words from the last word in `x` and the previous 4 words in `s->prev` */
+static VPAES_TARGET __m128i schedule_low_round(struct schedule *s, __m128i x)
+{
+	const __m128i s63 = LOAD(k_s63);
+	__m128i io, jo, p = s->prev;
+	p = _mm_xor_si128(p, _mm_slli_si128(p, 4));
+	p = _mm_xor_si128(p, _mm_slli_si128(p, 8));
+	p = _mm_xor_si128(p, s63);
+	invert(x, &io, &jo);
+	return s->prev = _mm_xor_si128(sbox_out(k_sb1, io, jo), p);
+}
+
+static VPAES_TARGET __m128i schedule_round(struct schedule *s, __m128i x)
+{
+	s->prev = _mm_xor_si128(s->prev, _mm_alignr_epi8(_mm_setzero_si128(), s->rcon, 15));
+	s->rcon = _mm_alignr_epi8(s->rcon, s->rcon, 15);
+	x = _mm_shuffle_epi32(x, 0xFF);
+	x = _mm_alignr_epi8(x, x, 1);
+	return schedule_low_round(s, x);
+}
+
+static VPAES_TARGET void schedule_store(struct schedule *s, __m128i x)
+{
+	if (s->decrypt)
+		_mm_storeu_si128((__m128i *) &s->key->key_dec[s->key->rounds - s->n], x);
+	else
+		_mm_storeu_si128((__m128i *) &s->key->key_exp[s->n], x);
+	s->n++;
+}
+
+/* writes a middle round key, mixed as the round function expects it */
+static VPAES_TARGET void schedule_mangle(struct schedule *s, __m128i x)
+{
+	const __m128i fwd = LOAD(k_mc_forward[0]);
+	const __m128i s0f = _mm_set1_epi8(0x0F);
+	__m128i hi, lo, t;
+	unsigned i;
+	if (s->decrypt) {
+		hi = _mm_srli_epi32(_mm_andnot_si128(s0f, x), 4);
+		lo = _mm_and_si128(x, s0f);
+		t = _mm_setzero_si128();
+		for (i = 0; i < 8; i += 2) {
+			t = _mm_xor_si128(t, _mm_shuffle_epi8(LOAD(k_dks[i]), lo));
+			t = _mm_xor_si128(t, _mm_shuffle_epi8(LOAD(k_dks[i + 1]), hi));
+			if (i < 6)
+				t = _mm_shuffle_epi8(t, fwd);
+		}
+	} else {
+		x = _mm_shuffle_epi8(_mm_xor_si128(x, LOAD(k_s63)), fwd);
+		t = x;
+		x = _mm_shuffle_epi8(x, fwd);
+		t = _mm_xor_si128(t, x);
+		x = _mm_shuffle_epi8(x, fwd);
+		t = _mm_xor_si128(t, x);
+	}
+	schedule_store(s, _mm_shuffle_epi8(t, LOAD(k_sr[s->sr])));
+	s->sr = (s->sr - 1) & 3;
+}
+
+static VPAES_TARGET void schedule_mangle_last(struct schedule *s, __m128i x)
+{
+	if (!s->decrypt)
+		x = _mm_shuffle_epi8(x, LOAD(k_sr[s->sr]));
+	x = _mm_xor_si128(x, LOAD(k_s63));
+	schedule_store(s, transform(x, s->decrypt ? k_deskew : k_opt));
+}
+
+static VPAES_TARGET __m128i schedule_192_smear(__m128i *lo, __m128i prev)
+{
+	__m128i x = _mm_xor_si128(*lo, _mm_shuffle_epi32(*lo, 0x80));
+	x = _mm_xor_si128(x, _mm_shuffle_epi32(prev, 0xFE));
+	*lo = _mm_unpackhi_epi64(_mm_setzero_si128(), x);
+	return x;
+}
+
+static VPAES_TARGET void schedule_core(struct vial_aes_key *key, const uint8_t *raw, int decrypt)
+{
+	struct schedule s;
+	__m128i x, lo, saved;
+	unsigned i;
+	s.key = key;
+	s.rcon = LOAD(k_rcon);
+	s.n = 0;
+	s.decrypt = decrypt;
+	x = _mm_loadu_si128((const __m128i *) raw);
+	if (decrypt) {
+		s.sr = ((((key->rounds - 6) * 16) & 32) ^ 32) >> 4;
+		schedule_store(&s, _mm_shuffle_epi8(x, LOAD(k_sr[s.sr])));
+		s.sr ^= 3;
+	} else {
+		s.sr = 3;
+	}
+	s.prev = x = transform(x, k_ipt);
+	if (!decrypt)
+		schedule_store(&s, x);
+	switch (key->rounds) {
+	case 10:
+		for (i = 10; ; --i) {
+			x = schedule_round(&s, x);
+			if (i == 1)
+				break;
+			schedule_mangle(&s, x);
+		}
+		break;
+	case 12:
+		x = transform(_mm_loadu_si128((const __m128i *) (raw + 8)), k_ipt);
+		lo = _mm_unpackhi_epi64(_mm_setzero_si128(), x);
+		for (i = 4; ; --i) {
+			x = schedule_round(&s, x);
+			x = _mm_alignr_epi8(x, lo, 8);
+			schedule_mangle(&s, x);
+			x = schedule_192_smear(&lo, s.prev);
+			schedule_mangle(&s, x);
+			x = schedule_round(&s, x);
+			if (i == 1)
+				break;
+			schedule_mangle(&s, x);
+			x = schedule_192_smear(&lo, s.prev);
+		}
+		break;
+	default:
+		x = transform(_mm_loadu_si128((const __m128i *) (raw + 16)), k_ipt);
+		for (i = 7; ; --i) {
+			schedule_mangle(&s, x);
+			lo = x;
+			x = schedule_round(&s, x);
+			if (i == 1)
+				break;
+			schedule_mangle(&s, x);
+			/* the low round works from the previous low half instead */
+			saved = s.prev;
+			s.prev = lo;
+			x = schedule_low_round(&s, _mm_shuffle_epi32(x, 0xFF));
+			s.prev = saved;
+		}
+		break;
+	}
+	schedule_mangle_last(&s, x);
+}
+
+static VPAES_TARGET void vpaes_key_init(struct vial_aes_key *key, const uint8_t *raw)
+{
+	schedule_core(key, raw, 0);
+	schedule_core(key, raw, 1);
+}
+
+static VPAES_TARGET void vpaes_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	_mm_storeu_si128((__m128i *) dst, encrypt_core(key, _mm_loadu_si128((const __m128i *) src)));
+}
+
+static VPAES_TARGET void vpaes_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src)
+{
+	_mm_storeu_si128((__m128i *) dst, decrypt_core(key, _mm_loadu_si128((const __m128i *) src)));
+}
+
+static VPAES_TARGET void vpaes_blocks_encrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	for (; nblocks > 0; --nblocks, src += VIAL_AES_BLOCK_SIZE, dst += VIAL_AES_BLOCK_SIZE)
+		vpaes_encrypt(key, dst, src);
+}
+
+static VPAES_TARGET void vpaes_blocks_decrypt(const struct vial_aes_key *key, uint8_t *dst, const uint8_t *src, size_t nblocks)
+{
+	for (; nblocks > 0; --nblocks, src += VIAL_AES_BLOCK_SIZE, dst += VIAL_AES_BLOCK_SIZE)
+		vpaes_decrypt(key, dst, src);
+}
+
+static const struct vial_aes_impl vpaes_impl = {
+	VIAL_AES_BACKEND_VPAES,
+	vpaes_key_init,
+	vpaes_encrypt,
+	vpaes_decrypt,
+	vpaes_blocks_encrypt,
+	vpaes_blocks_decrypt,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+const struct vial_aes_impl *vial_aes_impl_vpaes(void)
+{
+	return (vial_aes_cpu_features() & VIAL_AES_CPU_SSSE3) ? &vpaes_impl : NULL;
+}
+
+#else
+
+const struct vial_aes_impl *vial_aes_impl_vpaes(void)
+{
+	return NULL;
+}
+
+#endif
@@ -9,6 +9,7 @@ https://www.boost.org/LICENSE_1_0.txt
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "aes.h"
 
@@ -24,14 +25,25 @@ https://www.boost.org/LICENSE_1_0.txt
 
 #define BUFFER_SIZE 4096
 
-int main()
+static const struct {
+	enum vial_aes_backend backend;
+	const char *name;
+} backends[] = {
+	{ VIAL_AES_BACKEND_PORTABLE, "portable" },
+	{ VIAL_AES_BACKEND_AESNI, "AES-NI" },
+	{ VIAL_AES_BACKEND_BITSLICE, "bitsliced" },
+	{ VIAL_AES_BACKEND_VPAES, "vpaes" },
+	{ VIAL_AES_BACKEND_VAES, "VAES" },
+	{ VIAL_AES_BACKEND_ARMV8, "ARMv8" },
+	{ VIAL_AES_BACKEND_TTABLE, "T-table" }
+};
+
+static void bench_ctr(enum vial_aes_backend backend, const char *name, uint8_t *buffer)
 {
 	struct vial_aes_key key;
 	struct vial_aes_ctr aes;
-	uint8_t *buffer = malloc(BUFFER_SIZE);
-	for (unsigned i = 0; i < BUFFER_SIZE; ++i)
-		buffer[i] = i;
-	vial_aes_key_init(&key, 128, (const uint8_t *) "0123456789ABCDEF");
+	if (vial_aes_key_init_backend(&key, backend, 128, (const uint8_t *) "0123456789ABCDEF"))
+		return;
 	vial_aes_ctr_init_key(&aes, &key);
 	vial_aes_ctr_reset(&aes, (const uint8_t *) "ABCDEF654321", 12);
 	clock_t dur = clock();
@@ -39,7 +51,283 @@ int main()
 	vial_aes_ctr_crypt(&aes, buffer, buffer, BUFFER_SIZE);
 	tsc = __rdtsc() - tsc;
 	dur = clock() - dur;
+	printf("AES-CTR encryption speed (%s): %f MB/s; %f cpb\n", name, (BUFFER_SIZE / 1.0e6) * CLOCKS_PER_SEC / dur, tsc / (double) BUFFER_SIZE);
+}
+
+static void bench_gcm(enum vial_aes_backend backend, const char *name, uint8_t *buffer)
+{
+	struct vial_aes_key key;
+	struct vial_aes_gcm aes;
+	uint8_t tag[VIAL_AES_BLOCK_SIZE];
+	if (vial_aes_key_init_backend(&key, backend, 128, (const uint8_t *) "0123456789ABCDEF"))
+		return;
+	vial_aes_gcm_init_key(&aes, &key);
+	vial_aes_gcm_reset(&aes, (const uint8_t *) "ABCDEF654321", 12);
+	clock_t dur = clock();
+	uint64_t tsc = __rdtsc();
+	vial_aes_gcm_encrypt(&aes, buffer, buffer, BUFFER_SIZE);
+	vial_aes_gcm_get_tag(&aes, tag);
+	tsc = __rdtsc() - tsc;
+	dur = clock() - dur;
+	printf("AES-GCM encryption speed (%s): %f MB/s; %f cpb\n", name, (BUFFER_SIZE / 1.0e6) * CLOCKS_PER_SEC / dur, tsc / (double) BUFFER_SIZE);
+}
+
+#define SHORT_SIZE 64
+
+/* fixed cost of each message, as with RPCs, including the nonce and the tag */
+static void bench_eax_short(enum vial_aes_backend backend, const char *name, uint8_t *buffer)
+{
+	struct vial_aes_key key;
+	struct vial_aes_eax aes;
+	uint8_t nonce[12] = "ABCDEF654321", tag[VIAL_AES_BLOCK_SIZE];
+	if (vial_aes_key_init_backend(&key, backend, 128, (const uint8_t *) "0123456789ABCDEF"))
+		return;
+	vial_aes_eax_init_key(&aes, &key);
+	clock_t dur = clock();
+	uint64_t tsc = __rdtsc();
+	for (size_t pos = 0; pos < BUFFER_SIZE; pos += SHORT_SIZE) {
+		vial_aes_increment_be(nonce, sizeof(nonce));
+		vial_aes_eax_reset(&aes, nonce, sizeof(nonce));
+		vial_aes_eax_encrypt(&aes, buffer + pos, buffer + pos, SHORT_SIZE);
+		vial_aes_eax_get_tag(&aes, tag);
+	}
+	tsc = __rdtsc() - tsc;
+	dur = clock() - dur;
+	printf("AES-EAX %d byte message speed (%s): %f MB/s; %f cycles per message\n", SHORT_SIZE, name,
+		(BUFFER_SIZE / 1.0e6) * CLOCKS_PER_SEC / dur, tsc / (double) (BUFFER_SIZE / SHORT_SIZE));
+}
+
+#define SEAL_MAX 16384
+#define SEAL_TOTAL (256 * 1024)
+
+/* one-shot seal against the streaming API with the default backend, the streaming contexts include their setup */
+static void bench_seal(size_t size)
+{
+	static uint8_t buffer[SEAL_MAX + VIAL_AES_BLOCK_SIZE];
+	struct vial_aes_eax_key eax_key;
+	struct vial_aes_gcm_key gcm_key;
+	struct vial_aes_eax eax;
+	struct vial_aes_gcm gcm;
+	uint8_t nonce[12] = "ABCDEF654321", ad[13] = "header bytes";
+	const size_t count = SEAL_TOTAL / size;
+	uint64_t tsc[4];
+	vial_aes_eax_key_init(&eax_key, 128, (const uint8_t *) "0123456789ABCDEF");
+	vial_aes_gcm_key_init(&gcm_key, 128, (const uint8_t *) "0123456789ABCDEF");
+	tsc[0] = __rdtsc();
+	for (size_t i = 0; i < count; ++i) {
+		vial_aes_increment_be(nonce, sizeof(nonce));
+		vial_aes_eax_init_eax_key(&eax, &eax_key);
+		vial_aes_eax_reset(&eax, nonce, sizeof(nonce));
+		vial_aes_eax_auth_final(&eax, ad, sizeof(ad));
+		vial_aes_eax_encrypt(&eax, buffer, buffer, size);
+		vial_aes_eax_get_tag(&eax, buffer + size);
+	}
+	tsc[0] = __rdtsc() - tsc[0];
+	tsc[1] = __rdtsc();
+	for (size_t i = 0; i < count; ++i) {
+		vial_aes_increment_be(nonce, sizeof(nonce));
+		vial_aes_eax_seal(&eax_key, nonce, sizeof(nonce), ad, sizeof(ad), buffer, buffer, size);
+	}
+	tsc[1] = __rdtsc() - tsc[1];
+	tsc[2] = __rdtsc();
+	for (size_t i = 0; i < count; ++i) {
+		vial_aes_increment_be(nonce, sizeof(nonce));
+		vial_aes_gcm_init_gcm_key(&gcm, &gcm_key);
+		vial_aes_gcm_reset(&gcm, nonce, sizeof(nonce));
+		vial_aes_gcm_auth_final(&gcm, ad, sizeof(ad));
+		vial_aes_gcm_encrypt(&gcm, buffer, buffer, size);
+		vial_aes_gcm_get_tag(&gcm, buffer + size);
+	}
+	tsc[2] = __rdtsc() - tsc[2];
+	tsc[3] = __rdtsc();
+	for (size_t i = 0; i < count; ++i) {
+		vial_aes_increment_be(nonce, sizeof(nonce));
+		vial_aes_gcm_seal(&gcm_key, nonce, sizeof(nonce), ad, sizeof(ad), buffer, buffer, size);
+	}
+	tsc[3] = __rdtsc() - tsc[3];
+	printf("AES-EAX %zu byte message, streaming/seal: %f/%f cycles per message\n", size,
+		tsc[0] / (double) count, tsc[1] / (double) count);
+	printf("AES-GCM %zu byte message, streaming/seal: %f/%f cycles per message\n", size,
+		tsc[2] / (double) count, tsc[3] / (double) count);
+}
+
+#define FRAGMENT 1000
+
+/* contiguous buffers against fragments of 1000 bytes, which are not on block boundaries, with the default backend */
+static void bench_iov(enum vial_aes_mode mode, const char *name, uint8_t *buffer)
+{
+	static struct vial_aes_iovec iov[BUFFER_SIZE / FRAGMENT + 1];
+	struct vial_aes_key aes_key;
+	union vial_aes aes;
+	const uint8_t iv[16] = "ABCDEF654321";
+	size_t count = 0, len = BUFFER_SIZE - BUFFER_SIZE % VIAL_AES_BLOCK_SIZE;
+	uint64_t tsc[2];
+	for (size_t pos = 0; pos < len; pos += FRAGMENT, ++count)
+		iov[count] = (struct vial_aes_iovec) { buffer + pos, len - pos < FRAGMENT ? len - pos : FRAGMENT };
+	vial_aes_key_init(&aes_key, 128, (const uint8_t *) "0123456789ABCDEF");
+	vial_aes_init(&aes, mode);
+	vial_aes_init_key(&aes, &aes_key);
+	vial_aes_reset(&aes, iv, mode == VIAL_AES_MODE_GCM ? 12 : 16);
+	tsc[0] = __rdtsc();
+	vial_aes_encrypt(&aes, buffer, buffer, len);
+	tsc[0] = __rdtsc() - tsc[0];
+	vial_aes_reset(&aes, iv, mode == VIAL_AES_MODE_GCM ? 12 : 16);
+	tsc[1] = __rdtsc();
+	vial_aes_encrypt_iov(&aes, iov, count, iov, count);
+	tsc[1] = __rdtsc() - tsc[1];
+	printf("AES-%s contiguous/fragmented encryption speed: %f/%f cpb\n", name,
+		tsc[0] / (double) len, tsc[1] / (double) len);
+}
+
+#define BURST 128
+
+/* a burst of packets with the default backend, sealed one at a time against the batch functions */
+static void bench_aead_jobs(size_t size, unsigned nkeys)
+{
+	static uint8_t buffer[BURST][1500 + VIAL_AES_BLOCK_SIZE];
+	static struct vial_aes_eax_key eax_keys[BURST];
+	static struct vial_aes_gcm_key gcm_keys[BURST];
+	struct vial_aes_aead_job jobs[BURST];
+	uint8_t raw_key[16] = "0123456789ABCDEF", nonce[12] = "ABCDEF654321", ad[13] = "header bytes";
+	uint64_t tsc[4];
+	memset(buffer, 0, sizeof(buffer));
+	for (unsigned i = 0; i < nkeys; ++i) {
+		raw_key[0] = i;
+		vial_aes_eax_key_init(&eax_keys[i], 128, raw_key);
+		vial_aes_gcm_key_init(&gcm_keys[i], 128, raw_key);
+	}
+	for (unsigned i = 0; i < BURST; ++i) {
+		jobs[i] = (struct vial_aes_aead_job) { &gcm_keys[i % nkeys], &eax_keys[i % nkeys], nonce, sizeof(nonce),
+			ad, sizeof(ad), buffer[i], buffer[i], size, buffer[i] + size, VIAL_AES_ERROR_NONE };
+	}
+	tsc[0] = __rdtsc();
+	for (unsigned i = 0; i < BURST; ++i)
+		vial_aes_eax_seal(jobs[i].eax_key, nonce, sizeof(nonce), ad, sizeof(ad), buffer[i], buffer[i], size);
+	tsc[0] = __rdtsc() - tsc[0];
+	tsc[1] = __rdtsc();
+	vial_aes_eax_encrypt_jobs(jobs, BURST);
+	tsc[1] = __rdtsc() - tsc[1];
+	tsc[2] = __rdtsc();
+	for (unsigned i = 0; i < BURST; ++i)
+		vial_aes_gcm_seal(jobs[i].gcm_key, nonce, sizeof(nonce), ad, sizeof(ad), buffer[i], buffer[i], size);
+	tsc[2] = __rdtsc() - tsc[2];
+	tsc[3] = __rdtsc();
+	vial_aes_gcm_encrypt_jobs(jobs, BURST);
+	tsc[3] = __rdtsc() - tsc[3];
+	printf("AES-EAX burst of %d %zu byte packets with %u keys, seal/batch: %f/%f cycles per packet\n", BURST, size,
+		nkeys, tsc[0] / (double) BURST, tsc[1] / (double) BURST);
+	printf("AES-GCM burst of %d %zu byte packets with %u keys, seal/batch: %f/%f cycles per packet\n", BURST, size,
+		nkeys, tsc[2] / (double) BURST, tsc[3] / (double) BURST);
+}
+
+#define MESSAGES 16
+
+/* CMAC of independent messages, each with its own key */
+static void bench_cmac_jobs(enum vial_aes_backend backend, const char *name, uint8_t *buffer)
+{
+	struct vial_aes_key keys[MESSAGES];
+	struct vial_aes_job jobs[MESSAGES];
+	uint8_t raw_key[16] = "0123456789ABCDEF", tags[MESSAGES][VIAL_AES_BLOCK_SIZE];
+	const size_t len = BUFFER_SIZE / MESSAGES;
+	for (unsigned i = 0; i < MESSAGES; ++i) {
+		raw_key[0] = i;
+		if (vial_aes_key_init_backend(&keys[i], backend, 128, raw_key))
+			return;
+		jobs[i] = (struct vial_aes_job) { &keys[i], buffer + i * len, len, tags[i], NULL, VIAL_AES_BLOCK_SIZE };
+	}
+	clock_t dur = clock();
+	uint64_t tsc = __rdtsc();
+	vial_aes_cmac_jobs(jobs, MESSAGES);
+	tsc = __rdtsc() - tsc;
+	dur = clock() - dur;
+	printf("AES-CMAC multi-buffer speed (%s): %f MB/s; %f cpb\n", name, (BUFFER_SIZE / 1.0e6) * CLOCKS_PER_SEC / dur, tsc / (double) BUFFER_SIZE);
+}
+
+#define PARALLEL_SIZE (32 * 1024 * 1024)
+
+/* chunked streams of 64 KiB chunks, sealed into another buffer */
+static void bench_stream(struct vial_aes_pool *pool, unsigned nthreads, const uint8_t *buffer)
+{
+	static const char *const names[] = {"EAX", "GCM"};
+	static const uint8_t salt[VIAL_AES_STREAM_SALT_SIZE] = "ABCDEFGHIJKLMNOPQRSTUVW";
+	struct vial_aes_key key;
+	struct vial_aes_stream stream;
+	uint8_t *sealed;
+	vial_aes_key_init(&key, 128, (const uint8_t *) "0123456789ABCDEF");
+	vial_aes_stream_init(&stream, &key, VIAL_AES_MODE_GCM, 16, salt);
+	sealed = malloc((size_t) vial_aes_stream_size(&stream, PARALLEL_SIZE));
+	if (sealed == NULL)
+		return;
+	memset(sealed, 0, (size_t) vial_aes_stream_size(&stream, PARALLEL_SIZE));
+	for (enum vial_aes_mode mode = VIAL_AES_MODE_EAX; mode <= VIAL_AES_MODE_GCM; ++mode) {
+		vial_aes_stream_init(&stream, &key, mode, 16, salt);
+		uint64_t tsc = __rdtsc();
+		vial_aes_stream_seal(pool, &stream, 0, 1, sealed, buffer, PARALLEL_SIZE);
+		tsc = __rdtsc() - tsc;
+		printf("AES-%s chunked stream speed (%u threads): %f cpb\n", names[mode - VIAL_AES_MODE_EAX], nthreads,
+			tsc / (double) PARALLEL_SIZE);
+	}
+	free(sealed);
+}
+
+/* the time stamp counter measures the elapsed time, clock() would add up the time of all threads */
+static void bench_parallel(unsigned nthreads)
+{
+	struct vial_aes_pool *pool;
+	struct vial_aes_key key;
+	struct vial_aes_ctr ctr;
+	struct vial_aes_gcm gcm;
+	uint8_t *buffer = malloc(PARALLEL_SIZE), tag[VIAL_AES_BLOCK_SIZE];
+	if (buffer == NULL || vial_aes_pool_create(&pool, nthreads)) {
+		free(buffer);
+		return;
+	}
+	/* not measuring the page faults */
+	memset(buffer, 0, PARALLEL_SIZE);
+	vial_aes_key_init(&key, 128, (const uint8_t *) "0123456789ABCDEF");
+	vial_aes_ctr_init_key(&ctr, &key);
+	vial_aes_ctr_reset(&ctr, (const uint8_t *) "ABCDEF654321", 12);
+	uint64_t tsc = __rdtsc();
+	vial_aes_ctr_crypt_parallel(pool, &ctr, buffer, buffer, PARALLEL_SIZE);
+	tsc = __rdtsc() - tsc;
+	printf("AES-CTR parallel encryption speed (%u threads): %f cpb\n", nthreads, tsc / (double) PARALLEL_SIZE);
+	vial_aes_gcm_init_key(&gcm, &key);
+	vial_aes_gcm_reset(&gcm, (const uint8_t *) "ABCDEF654321", 12);
+	tsc = __rdtsc();
+	vial_aes_gcm_encrypt_parallel(pool, &gcm, buffer, buffer, PARALLEL_SIZE);
+	vial_aes_gcm_get_tag(&gcm, tag);
+	tsc = __rdtsc() - tsc;
+	printf("AES-GCM parallel encryption speed (%u threads): %f cpb\n", nthreads, tsc / (double) PARALLEL_SIZE);
+	bench_stream(pool, nthreads, buffer);
+	vial_aes_pool_destroy(pool);
+	free(buffer);
+}
+
+int main()
+{
+	uint8_t *buffer = malloc(BUFFER_SIZE);
+	for (unsigned i = 0; i < BUFFER_SIZE; ++i)
+		buffer[i] = i;
+	for (unsigned i = 0; i < sizeof(backends) / sizeof(*backends); ++i)
+		bench_ctr(backends[i].backend, backends[i].name, buffer);
+	for (unsigned i = 0; i < sizeof(backends) / sizeof(*backends); ++i)
+		bench_gcm(backends[i].backend, backends[i].name, buffer);
+	for (unsigned i = 0; i < sizeof(backends) / sizeof(*backends); ++i)
+		bench_eax_short(backends[i].backend, backends[i].name, buffer);
+	for (size_t size = 16; size <= SEAL_MAX; size *= 4)
+		bench_seal(size);
+	bench_iov(VIAL_AES_MODE_CBC, "CBC", buffer);
+	bench_iov(VIAL_AES_MODE_CTR, "CTR", buffer);
+	bench_iov(VIAL_AES_MODE_GCM, "GCM", buffer);
+	for (unsigned nkeys = 1; nkeys <= BURST; nkeys *= BURST) {
+		bench_aead_jobs(64, nkeys);
+		bench_aead_jobs(256, nkeys);
+		bench_aead_jobs(1500, nkeys);
+	}
+	for (unsigned i = 0; i < sizeof(backends) / sizeof(*backends); ++i)
+		bench_cmac_jobs(backends[i].backend, backends[i].name, buffer);
+	for (unsigned nthreads = 1; nthreads <= 8; nthreads *= 2)
+		bench_parallel(nthreads);
 	free(buffer);
-	printf("AES-CTR encryption speed: %f MB/s; %f cpb\n", (BUFFER_SIZE / 1.0e6) * CLOCKS_PER_SEC / dur, tsc / (double) BUFFER_SIZE);
 	return 0;
 }
@@ -195,7 +195,23 @@ static void print_hex(const uint8_t *src, size_t len)
 		printf("%02X", *src);
 }
 
-static int test_aes(const struct aes_testcase *test)
+struct backend {
+	enum vial_aes_backend backend;
+	const char *name;
+};
+
+static const struct backend backends[] = {
+	{ VIAL_AES_BACKEND_PORTABLE, "portable" },
+	{ VIAL_AES_BACKEND_AESNI, "AES-NI" },
+	{ VIAL_AES_BACKEND_BITSLICE, "bitsliced" },
+	{ VIAL_AES_BACKEND_VPAES, "vpaes" },
+	{ VIAL_AES_BACKEND_VAES, "VAES" },
+	{ VIAL_AES_BACKEND_ARMV8, "ARMv8" },
+	{ VIAL_AES_BACKEND_TTABLE, "T-table" },
+	{ VIAL_AES_BACKEND_AUTO, NULL }
+};
+
+static int test_aes(const struct aes_testcase *test, enum vial_aes_backend backend)
 {	struct vial_aes_key aes_key;
 	union vial_aes aes;
 	const char *mode;
@@ -233,7 +249,7 @@ static int test_aes(const struct aes_testcase *test)
 		code = 31;
 		goto exit;
 	}
-	vial_aes_key_init(&aes_key, key_size * 8, key);
+	vial_aes_key_init_backend(&aes_key, backend, key_size * 8, key);
 	vial_aes_init(&aes, test->mode);
 	vial_aes_init_key(&aes, &aes_key);
 	vial_aes_reset(&aes, iv, iv_size);
@@ -280,7 +296,7 @@ exit:
 	return code;
 }
 
-static int test_cmac(const struct cmac_testcase *test)
+static int test_cmac(const struct cmac_testcase *test, enum vial_aes_backend backend)
 {
 	struct vial_aes_key aes_key;
 	struct vial_aes_cmac cmac;
@@ -298,7 +314,7 @@ static int test_cmac(const struct cmac_testcase *test)
 		code = 31;
 		goto exit;
 	}
-	vial_aes_key_init(&aes_key, key_size * 8, key);
+	vial_aes_key_init_backend(&aes_key, backend, key_size * 8, key);
 	if (msg_size < 19) {
 		vial_aes_cmac_tag(&aes_key, result, tag_size, msg, msg_size);
 	} else { /* test partial updates */
@@ -320,18 +336,858 @@ exit:
 	return code;
 }
 
-int main()
+#define LONG_SIZE (VIAL_AES_BLOCK_SIZE * 101)
+
+/* processes `len` bytes in uneven pieces, so that partial blocks and all batch sizes are exercised */
+static enum vial_aes_error crypt_pieces(union vial_aes *aes, bool encrypt, uint8_t *dst, const uint8_t *src, size_t len)
+{
+	static const size_t pieces[] = {1, 15, 17, 3, 200, 16, 64, 5, 128, 300};
+	const size_t align = aes->base.vtable->mode <= VIAL_AES_MODE_CBC ? VIAL_AES_BLOCK_SIZE : 1;
+	enum vial_aes_error err = VIAL_AES_ERROR_NONE;
+	size_t n;
+	for (unsigned i = 0; len > 0 && !err; ++i, len -= n, src += n, dst += n) {
+		n = pieces[i % (sizeof(pieces) / sizeof(*pieces))];
+		n = (n + align - 1) / align * align;
+		if (n > len)
+			n = len;
+		err = encrypt ? vial_aes_encrypt(aes, dst, src, n) : vial_aes_decrypt(aes, dst, src, n);
+	}
+	return err;
+}
+
+/* compares a backend with the portable implementation on messages longer than the test vectors */
+static int test_long(enum vial_aes_backend backend)
+{
+	static const enum vial_aes_mode modes[] = {
+		VIAL_AES_MODE_ECB, VIAL_AES_MODE_CBC, VIAL_AES_MODE_CTR, VIAL_AES_MODE_EAX, VIAL_AES_MODE_GCM
+	};
+	static const uint8_t iv[12] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88};
+	struct vial_aes_key ref_key, aes_key;
+	union vial_aes ref, aes;
+	uint8_t raw_key[32], plain[LONG_SIZE], expected[LONG_SIZE + VIAL_AES_BLOCK_SIZE], result[LONG_SIZE + VIAL_AES_BLOCK_SIZE];
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 7 + 1;
+	for (unsigned i = 0; i < LONG_SIZE; ++i)
+		plain[i] = i * 13 + 5;
+	for (unsigned keybits = 128; keybits <= 256; keybits += 64) {
+		vial_aes_key_init_backend(&ref_key, VIAL_AES_BACKEND_PORTABLE, keybits, raw_key);
+		vial_aes_key_init_backend(&aes_key, backend, keybits, raw_key);
+		for (unsigned m = 0; m < sizeof(modes) / sizeof(*modes); ++m) {
+			const bool aead = modes[m] == VIAL_AES_MODE_EAX || modes[m] == VIAL_AES_MODE_GCM;
+			const size_t iv_size = modes[m] <= VIAL_AES_MODE_CTR ? 16 : 12;
+			uint8_t cbc_iv[16] = {0};
+			memcpy(cbc_iv, iv, sizeof(iv));
+			/* the CTR counter carries out of its low 64 bits in the middle of a 300 byte piece */
+			if (modes[m] == VIAL_AES_MODE_CTR)
+				memcpy(cbc_iv + 8, "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xDD", 8);
+			vial_aes_init(&ref, modes[m]);
+			vial_aes_init_key(&ref, &ref_key);
+			vial_aes_reset(&ref, cbc_iv, iv_size);
+			vial_aes_init(&aes, modes[m]);
+			vial_aes_init_key(&aes, &aes_key);
+			vial_aes_reset(&aes, cbc_iv, iv_size);
+			if (aead) {
+				vial_aes_auth_final(&ref, plain, 21);
+				vial_aes_auth_final(&aes, plain, 21);
+			}
+			vial_aes_encrypt(&ref, expected, plain, LONG_SIZE);
+			if (crypt_pieces(&aes, true, result, plain, LONG_SIZE))
+				return 41;
+			if (aead) {
+				vial_aes_get_tag(&ref, expected + LONG_SIZE);
+				vial_aes_get_tag(&aes, result + LONG_SIZE);
+			}
+			if (memcmp(expected, result, aead ? LONG_SIZE + VIAL_AES_BLOCK_SIZE : LONG_SIZE)) {
+				printf("AES-%u mode %d differs from portable when encrypting\n", keybits, modes[m]);
+				return 42;
+			}
+			vial_aes_reset(&aes, cbc_iv, iv_size);
+			if (aead)
+				vial_aes_auth_final(&aes, plain, 21);
+			if (crypt_pieces(&aes, false, result, result, LONG_SIZE))
+				return 41;
+			if (aead && vial_aes_check_tag(&aes, expected + LONG_SIZE)) {
+				printf("AES-%u mode %d tag check failed\n", keybits, modes[m]);
+				return 43;
+			}
+			if (memcmp(plain, result, LONG_SIZE)) {
+				printf("AES-%u mode %d failed decrypting in place\n", keybits, modes[m]);
+				return 43;
+			}
+		}
+	}
+	return 0;
+}
+
+/* compares contexts sharing a GCM key with one owning its hash key, and with a copy of it */
+static int test_gcm_key(enum vial_aes_backend backend)
+{
+	static const uint8_t nonce[12] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88};
+	struct vial_aes_gcm_key gcm_key;
+	struct vial_aes_key aes_key;
+	struct vial_aes_gcm own, shared, copy;
+	uint8_t raw_key[32], plain[LONG_SIZE], expected[LONG_SIZE + 16], result[LONG_SIZE + 16];
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 7 + 1;
+	for (unsigned i = 0; i < LONG_SIZE; ++i)
+		plain[i] = i * 13 + 5;
+	for (unsigned keybits = 128; keybits <= 256; keybits += 64) {
+		vial_aes_key_init_backend(&aes_key, backend, keybits, raw_key);
+		if (vial_aes_gcm_key_init_backend(&gcm_key, backend, keybits, raw_key))
+			return 44;
+		vial_aes_gcm_init_key(&own, &aes_key);
+		vial_aes_gcm_reset(&own, nonce, sizeof(nonce));
+		vial_aes_gcm_auth_final(&own, plain, 21);
+		vial_aes_gcm_encrypt(&own, expected, plain, LONG_SIZE);
+		vial_aes_gcm_get_tag(&own, expected + LONG_SIZE);
+		vial_aes_gcm_init_gcm_key(&shared, &gcm_key);
+		vial_aes_gcm_reset(&shared, nonce, sizeof(nonce));
+		vial_aes_gcm_auth_final(&shared, plain, 21);
+		vial_aes_gcm_encrypt(&shared, result, plain, LONG_SIZE);
+		vial_aes_gcm_get_tag(&shared, result + LONG_SIZE);
+		if (memcmp(expected, result, sizeof(result))) {
+			printf("AES-%u GCM with a shared key differs\n", keybits);
+			return 45;
+		}
+		/* the copy must not depend on the context it was copied from */
+		vial_aes_gcm_reset(&own, nonce, sizeof(nonce));
+		copy = own;
+		memset(&own, 0, sizeof(own));
+		vial_aes_gcm_auth_final(&copy, plain, 21);
+		vial_aes_gcm_decrypt(&copy, result, expected, LONG_SIZE);
+		if (vial_aes_gcm_check_tag(&copy, expected + LONG_SIZE) || memcmp(plain, result, LONG_SIZE)) {
+			printf("AES-%u GCM copied context failed\n", keybits);
+			return 46;
+		}
+	}
+	return 0;
+}
+
+/* adds to the low `width` bytes of a big-endian counter */
+static void counter_add(uint8_t *counter, size_t width, uint64_t n)
+{
+	unsigned carry = 0;
+	for (size_t i = VIAL_AES_BLOCK_SIZE; i --> VIAL_AES_BLOCK_SIZE - width; n >>= 8) {
+		carry += counter[i] + (n & 0xFF);
+		counter[i] = (uint8_t) carry;
+		carry >>= 8;
+	}
+}
+
+/* checks that the counter wraps around within its width, against ECB encryption of the expected counters */
+static int test_counter_bits(enum vial_aes_backend backend)
 {
+	static const unsigned widths[] = {32, 64, 128}, offsets[] = {0, 1, 16, 17, 200, 207, 624, 639};
+	const uint64_t far_blocks = 0x0FEDCBA987654321U;
+	struct vial_aes_key aes_key;
+	struct vial_aes_ecb ecb;
+	union vial_aes aes;
+	uint8_t iv[16], counters[VIAL_AES_BLOCK_SIZE * 40], expected[sizeof(counters)], result[sizeof(counters)];
+	vial_aes_key_init_backend(&aes_key, backend, 128, (const uint8_t *) "0123456789ABCDEF");
+	memset(iv, 0xFF, sizeof(iv));
+	iv[15] = 0xF3;
+	for (unsigned w = 0; w < sizeof(widths) / sizeof(*widths); ++w) {
+		const size_t n = widths[w] / 8;
+		uint8_t counter[16];
+		memcpy(counter, iv, sizeof(iv));
+		for (unsigned i = 0; i < sizeof(counters) / VIAL_AES_BLOCK_SIZE; ++i) {
+			memcpy(counters + i * VIAL_AES_BLOCK_SIZE, counter, VIAL_AES_BLOCK_SIZE);
+			vial_aes_increment_be(counter + VIAL_AES_BLOCK_SIZE - n, n);
+		}
+		vial_aes_ecb_init_key(&ecb, &aes_key);
+		vial_aes_ecb_encrypt(&ecb, expected, counters, sizeof(counters));
+		vial_aes_init(&aes, VIAL_AES_MODE_CTR);
+		vial_aes_init_key(&aes, &aes_key);
+		if (vial_aes_ctr_set_counter_bits(&aes.ctr, widths[w]))
+			return 51;
+		vial_aes_reset(&aes, iv, sizeof(iv));
+		memset(result, 0, sizeof(result));
+		if (crypt_pieces(&aes, true, result, result, sizeof(result)))
+			return 51;
+		if (memcmp(expected, result, sizeof(result))) {
+			printf("AES-CTR with a %u-bit counter failed\n", widths[w]);
+			return 52;
+		}
+		/* seeking within and between blocks, across the wrap around, and to the last bytes */
+		for (unsigned o = 0; o < sizeof(offsets) / sizeof(*offsets); ++o) {
+			const size_t len = sizeof(result) - offsets[o] < 20 ? sizeof(result) - offsets[o] : 20;
+			memset(result, 0, len);
+			vial_aes_ctr_seek(&aes.ctr, offsets[o]);
+			vial_aes_ctr_crypt(&aes.ctr, result, result, len);
+			if (memcmp(expected + offsets[o], result, len)) {
+				printf("AES-CTR with a %u-bit counter failed seeking to %u\n", widths[w], offsets[o]);
+				return 53;
+			}
+		}
+		/* far enough to carry out of the low 64 bits of the 128-bit counter */
+		memcpy(counters, iv, sizeof(iv));
+		counter_add(counters, n, far_blocks);
+		memcpy(counters + VIAL_AES_BLOCK_SIZE, counters, VIAL_AES_BLOCK_SIZE);
+		counter_add(counters + VIAL_AES_BLOCK_SIZE, n, 1);
+		vial_aes_ecb_encrypt(&ecb, expected, counters, 2 * VIAL_AES_BLOCK_SIZE);
+		memset(result, 0, 20);
+		vial_aes_ctr_seek(&aes.ctr, far_blocks * VIAL_AES_BLOCK_SIZE + 7);
+		vial_aes_ctr_crypt(&aes.ctr, result, result, 20);
+		if (memcmp(expected + 7, result, 20)) {
+			printf("AES-CTR with a %u-bit counter failed seeking far\n", widths[w]);
+			return 53;
+		}
+		if (widths[w] == 128) {
+			memset(result, 0, 20);
+			vial_aes_ctr_crypt_at(&aes_key, iv, sizeof(iv), far_blocks * VIAL_AES_BLOCK_SIZE + 7, result, result, 20);
+			if (memcmp(expected + 7, result, 20)) {
+				puts("AES-CTR failed encrypting at an offset");
+				return 53;
+			}
+		}
+	}
+	return 0;
+}
+
+/* OMAC of `len` bytes with tweak `t`, as in the definition of EAX */
+static void eax_omac(const struct vial_aes_key *key, uint8_t *tag, uint8_t t, const uint8_t *src, size_t len)
+{
+	uint8_t buf[VIAL_AES_BLOCK_SIZE + 128] = {0};
+	buf[VIAL_AES_BLOCK_SIZE - 1] = t;
+	memcpy(buf + VIAL_AES_BLOCK_SIZE, src, len);
+	vial_aes_cmac_tag(key, tag, VIAL_AES_BLOCK_SIZE, buf, VIAL_AES_BLOCK_SIZE + len);
+}
+
+/* checks EAX against its definition for empty and short nonces, headers and messages */
+static int test_eax_lengths(enum vial_aes_backend backend)
+{
+	static const size_t nonce_lens[] = {0, 12, 16}, header_lens[] = {0, 5, 16, 33}, msg_lens[] = {0, 1, 16, 64, 70};
+	struct vial_aes_key aes_key;
+	struct vial_aes_eax eax;
+	struct vial_aes_ctr ctr;
+	uint8_t data[128], expected[128], result[128], tag[16], omac[16];
+	for (unsigned i = 0; i < sizeof(data); ++i)
+		data[i] = i * 13 + 5;
+	vial_aes_key_init_backend(&aes_key, backend, 128, (const uint8_t *) "0123456789ABCDEF");
+	vial_aes_eax_init_key(&eax, &aes_key);
+	for (unsigned n = 0; n < sizeof(nonce_lens) / sizeof(*nonce_lens); ++n)
+	for (unsigned h = 0; h < sizeof(header_lens) / sizeof(*header_lens); ++h)
+	for (unsigned m = 0; m < sizeof(msg_lens) / sizeof(*msg_lens); ++m) {
+		const uint8_t *nonce = data + 100, *header = data + 50;
+		const size_t msg_len = msg_lens[m];
+		eax_omac(&aes_key, tag, 0, nonce, nonce_lens[n]);
+		vial_aes_ctr_init_key(&ctr, &aes_key);
+		vial_aes_ctr_reset(&ctr, tag, sizeof(tag));
+		vial_aes_ctr_crypt(&ctr, expected, data, msg_len);
+		eax_omac(&aes_key, omac, 1, header, header_lens[h]);
+		for (unsigned i = 0; i < 16; ++i)
+			tag[i] ^= omac[i];
+		eax_omac(&aes_key, omac, 2, expected, msg_len);
+		for (unsigned i = 0; i < 16; ++i)
+			expected[msg_len + i] = tag[i] ^ omac[i];
+		vial_aes_eax_reset(&eax, nonce, nonce_lens[n]);
+		/* without a header auth_final is left to the first encryption */
+		if (header_lens[h] > 0) {
+			vial_aes_eax_auth_update(&eax, header, 1);
+			vial_aes_eax_auth_final(&eax, header + 1, header_lens[h] - 1);
+		}
+		vial_aes_eax_encrypt(&eax, result, data, msg_len);
+		vial_aes_eax_get_tag(&eax, result + msg_len);
+		if (memcmp(expected, result, msg_len + 16)) {
+			printf("EAX with nonce %zu, header %zu, message %zu bytes failed\n", nonce_lens[n], header_lens[h], msg_len);
+			return 71;
+		}
+		vial_aes_eax_reset(&eax, nonce, nonce_lens[n]);
+		vial_aes_eax_auth_final(&eax, header, header_lens[h]);
+		vial_aes_eax_decrypt(&eax, result, result, msg_len);
+		if (vial_aes_eax_check_tag(&eax, expected + msg_len) || memcmp(data, result, msg_len)) {
+			printf("EAX decryption with nonce %zu, header %zu, message %zu bytes failed\n", nonce_lens[n],
+				header_lens[h], msg_len);
+			return 72;
+		}
+	}
+	return 0;
+}
+
+/* one-shot functions against the streaming API, with headers shorter and longer than the message */
+static int test_seal(enum vial_aes_backend backend)
+{
+	static const uint8_t nonce[12] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88};
+	static const size_t ad_lens[] = {0, 1, 16, 20, 32, 48, 200}, lens[] = {0, 1, 15, 16, 17, 32, 33, 100, 112, LONG_SIZE};
+	static const uint8_t zero[LONG_SIZE] = {0};
+	struct vial_aes_key aes_key;
+	struct vial_aes_eax_key eax_key;
+	struct vial_aes_gcm_key gcm_key;
+	struct vial_aes_eax eax;
+	struct vial_aes_gcm gcm;
+	uint8_t raw_key[32], plain[LONG_SIZE], expected[LONG_SIZE + 16], result[LONG_SIZE + 16];
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 5 + 3;
+	for (unsigned i = 0; i < LONG_SIZE; ++i)
+		plain[i] = i * 11 + 7;
+	for (unsigned keybits = 128; keybits <= 256; keybits += 64) {
+		vial_aes_key_init_backend(&aes_key, backend, keybits, raw_key);
+		vial_aes_eax_key_init_backend(&eax_key, backend, keybits, raw_key);
+		vial_aes_gcm_key_init_backend(&gcm_key, backend, keybits, raw_key);
+		for (size_t i = 0; i < sizeof(ad_lens) / sizeof(ad_lens[0]); ++i) {
+			for (size_t j = 0; j < sizeof(lens) / sizeof(lens[0]); ++j) {
+				size_t ad_len = ad_lens[i], len = lens[j];
+				const uint8_t *ad = plain + LONG_SIZE - ad_len;
+				vial_aes_eax_init_key(&eax, &aes_key);
+				vial_aes_eax_reset(&eax, nonce, sizeof(nonce));
+				vial_aes_eax_auth_final(&eax, ad, ad_len);
+				vial_aes_eax_encrypt(&eax, expected, plain, len);
+				vial_aes_eax_get_tag(&eax, expected + len);
+				vial_aes_eax_seal(&eax_key, nonce, sizeof(nonce), ad, ad_len, result, plain, len);
+				if (memcmp(expected, result, len + 16)) {
+					printf("AES-%u EAX seal of %zu bytes with %zu byte header differs\n", keybits, len, ad_len);
+					return 91;
+				}
+				if (vial_aes_eax_open(&eax_key, nonce, sizeof(nonce), ad, ad_len, result, result, len + 16)
+					|| memcmp(plain, result, len)) {
+					printf("AES-%u EAX open of %zu bytes with %zu byte header failed\n", keybits, len, ad_len);
+					return 92;
+				}
+				vial_aes_gcm_init_key(&gcm, &aes_key);
+				vial_aes_gcm_reset(&gcm, nonce, sizeof(nonce));
+				vial_aes_gcm_auth_final(&gcm, ad, ad_len);
+				vial_aes_gcm_encrypt(&gcm, expected, plain, len);
+				vial_aes_gcm_get_tag(&gcm, expected + len);
+				vial_aes_gcm_seal(&gcm_key, nonce, sizeof(nonce), ad, ad_len, result, plain, len);
+				if (memcmp(expected, result, len + 16)) {
+					printf("AES-%u GCM seal of %zu bytes with %zu byte header differs\n", keybits, len, ad_len);
+					return 93;
+				}
+				if (vial_aes_gcm_open(&gcm_key, nonce, sizeof(nonce), ad, ad_len, result, result, len + 16)
+					|| memcmp(plain, result, len)) {
+					printf("AES-%u GCM open of %zu bytes with %zu byte header failed\n", keybits, len, ad_len);
+					return 94;
+				}
+			}
+		}
+		/* a forged message must not be released */
+		vial_aes_eax_seal(&eax_key, nonce, sizeof(nonce), NULL, 0, expected, plain, 100);
+		expected[100] ^= 1;
+		if (vial_aes_eax_open(&eax_key, nonce, sizeof(nonce), NULL, 0, result, expected, 116) != VIAL_AES_ERROR_MAC
+			|| memcmp(result, zero, 100)) {
+			printf("AES-%u EAX open accepted a wrong tag\n", keybits);
+			return 95;
+		}
+		vial_aes_gcm_seal(&gcm_key, nonce, sizeof(nonce), NULL, 0, expected, plain, LONG_SIZE);
+		expected[0] ^= 1;
+		memset(result, 0xFF, LONG_SIZE);
+		if (vial_aes_gcm_open(&gcm_key, nonce, sizeof(nonce), NULL, 0, result, expected, LONG_SIZE + 16)
+			!= VIAL_AES_ERROR_MAC || memcmp(result, zero, LONG_SIZE)) {
+			printf("AES-%u GCM open accepted a modified ciphertext\n", keybits);
+			return 96;
+		}
+		if (vial_aes_gcm_seal(&gcm_key, nonce, 8, NULL, 0, result, plain, 16) != VIAL_AES_ERROR_IV
+			|| vial_aes_gcm_open(&gcm_key, nonce, sizeof(nonce), NULL, 0, result, expected, 15) != VIAL_AES_ERROR_LENGTH) {
+			printf("AES-%u GCM seal accepted invalid lengths\n", keybits);
+			return 97;
+		}
+	}
+	return 0;
+}
+
+#define PACKETS 40
+#define PACKET_MAX 1500
+
+/* batch AEAD against the one-shot functions, with three keys of different sizes in runs and mixed */
+static int test_aead_jobs(enum vial_aes_backend backend)
+{
+	static uint8_t plain[PACKET_MAX], out[PACKETS][PACKET_MAX], tags[PACKETS][VIAL_AES_BLOCK_SIZE],
+		expected[PACKET_MAX + VIAL_AES_BLOCK_SIZE], zero[PACKET_MAX];
+	struct vial_aes_gcm_key gcm_keys[3];
+	struct vial_aes_eax_key eax_keys[3];
+	struct vial_aes_aead_job jobs[PACKETS];
+	uint8_t raw_key[32], nonces[PACKETS][12];
+	enum vial_aes_error err;
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 3 + 1;
+	for (unsigned i = 0; i < PACKET_MAX; ++i)
+		plain[i] = i * 7 + 2;
+	for (unsigned k = 0; k < 3; ++k) {
+		raw_key[0] = k;
+		vial_aes_gcm_key_init_backend(&gcm_keys[k], backend, 128 + 64 * k, raw_key);
+		vial_aes_eax_key_init_backend(&eax_keys[k], backend, 128 + 64 * k, raw_key);
+	}
+	for (int eax = 0; eax < 2; ++eax) {
+		for (unsigned i = 0; i < PACKETS; ++i) {
+			unsigned k = i < 20 ? i / 7 % 3 : i % 3;
+			memset(nonces[i], 0, sizeof(nonces[i]));
+			nonces[i][11] = i;
+			jobs[i] = (struct vial_aes_aead_job) { &gcm_keys[k], &eax_keys[k], nonces[i], sizeof(nonces[i]),
+				plain + i, i * 5 % 40, plain, out[i], i % 5 == 4 ? PACKET_MAX : i * 37 % 300, tags[i],
+				VIAL_AES_ERROR_NONE };
+		}
+		err = eax ? vial_aes_eax_encrypt_jobs(jobs, PACKETS) : vial_aes_gcm_encrypt_jobs(jobs, PACKETS);
+		if (err) {
+			printf("%s batch encryption failed\n", eax ? "EAX" : "GCM");
+			return 101;
+		}
+		for (unsigned i = 0; i < PACKETS; ++i) {
+			const struct vial_aes_aead_job *job = &jobs[i];
+			if (eax)
+				vial_aes_eax_seal(job->eax_key, job->nonce, job->nonce_len, job->ad, job->ad_len, expected, plain, job->len);
+			else
+				vial_aes_gcm_seal(job->gcm_key, job->nonce, job->nonce_len, job->ad, job->ad_len, expected, plain, job->len);
+			if (job->status || memcmp(expected, out[i], job->len) || memcmp(expected + job->len, tags[i], 16)) {
+				printf("%s batch encryption of packet %u differs\n", eax ? "EAX" : "GCM", i);
+				return 102;
+			}
+		}
+		/* in place, with some forged packets */
+		for (unsigned i = 0; i < PACKETS; ++i) {
+			jobs[i].src = out[i];
+			if (i % 7 == 3)
+				tags[i][i % 16] ^= 0x40;
+		}
+		err = eax ? vial_aes_eax_decrypt_jobs(jobs, PACKETS) : vial_aes_gcm_decrypt_jobs(jobs, PACKETS);
+		if (err != VIAL_AES_ERROR_MAC) {
+			printf("%s batch decryption did not report the forged packets\n", eax ? "EAX" : "GCM");
+			return 103;
+		}
+		for (unsigned i = 0; i < PACKETS; ++i) {
+			if (i % 7 == 3 ? jobs[i].status != VIAL_AES_ERROR_MAC || memcmp(out[i], zero, jobs[i].len)
+				: jobs[i].status || memcmp(out[i], plain, jobs[i].len)) {
+				printf("%s batch decryption of packet %u failed\n", eax ? "EAX" : "GCM", i);
+				return 104;
+			}
+		}
+	}
+	jobs[1].nonce_len = 8;
+	if (vial_aes_gcm_encrypt_jobs(jobs, 3) != VIAL_AES_ERROR_IV || jobs[1].status != VIAL_AES_ERROR_IV
+		|| jobs[0].status || jobs[2].status) {
+		puts("GCM batch accepted an invalid nonce");
+		return 105;
+	}
+	return 0;
+}
+
+/* splits `len` bytes into fragments of the given sizes, the last one taking the rest */
+static size_t split_iov(struct vial_aes_iovec *iov, uint8_t *buf, const size_t *sizes, size_t count, size_t len)
+{
+	size_t i, n;
+	for (i = 0; i < count - 1; ++i, buf += n, len -= n) {
+		n = sizes[i] < len ? sizes[i] : len;
+		iov[i] = (struct vial_aes_iovec) { buf, n };
+	}
+	iov[i] = (struct vial_aes_iovec) { buf, len };
+	return count;
+}
+
+/* compares the scatter/gather functions with contiguous buffers, with fragments not on block boundaries */
+static int test_iov(enum vial_aes_backend backend)
+{
+	static const enum vial_aes_mode modes[] = {
+		VIAL_AES_MODE_ECB, VIAL_AES_MODE_CBC, VIAL_AES_MODE_CTR, VIAL_AES_MODE_EAX, VIAL_AES_MODE_GCM
+	};
+	static const uint8_t iv[16] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88};
+	static const size_t src_sizes[] = {5, 0, 16, 27, 1, 300, 0, 7, 100}, dst_sizes[] = {33, 7, 0, 64, 2, 2, 500},
+		ad_sizes[] = {3, 0, 17, 0};
+	struct vial_aes_iovec src_iov[9], dst_iov[7], ad_iov[4];
+	struct vial_aes_key aes_key;
+	union vial_aes aes;
+	uint8_t raw_key[32], plain[LONG_SIZE], expected[LONG_SIZE + 16], result[LONG_SIZE + 16];
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 3 + 2;
+	for (unsigned i = 0; i < LONG_SIZE; ++i)
+		plain[i] = i * 17 + 9;
+	vial_aes_key_init_backend(&aes_key, backend, 128, raw_key);
+	for (unsigned m = 0; m < sizeof(modes) / sizeof(*modes); ++m) {
+		const bool aead = modes[m] == VIAL_AES_MODE_EAX || modes[m] == VIAL_AES_MODE_GCM;
+		const size_t iv_size = aead ? 12 : 16;
+		vial_aes_init(&aes, modes[m]);
+		vial_aes_init_key(&aes, &aes_key);
+		vial_aes_reset(&aes, iv, iv_size);
+		if (aead)
+			vial_aes_auth_final(&aes, plain, 40);
+		vial_aes_encrypt(&aes, expected, plain, LONG_SIZE);
+		if (aead)
+			vial_aes_get_tag(&aes, expected + LONG_SIZE);
+		split_iov(src_iov, plain, src_sizes, 9, LONG_SIZE);
+		split_iov(dst_iov, result, dst_sizes, 7, LONG_SIZE);
+		vial_aes_reset(&aes, iv, iv_size);
+		if (aead && vial_aes_auth_final_iov(&aes, ad_iov, split_iov(ad_iov, plain, ad_sizes, 4, 40)))
+			return 111;
+		if (vial_aes_encrypt_iov(&aes, dst_iov, 7, src_iov, 9))
+			return 111;
+		if (aead)
+			vial_aes_get_tag(&aes, result + LONG_SIZE);
+		if (memcmp(expected, result, aead ? LONG_SIZE + 16 : LONG_SIZE)) {
+			printf("AES mode %d differs when encrypting fragments\n", modes[m]);
+			return 112;
+		}
+		/* in place, with the fragments of the destination */
+		vial_aes_reset(&aes, iv, iv_size);
+		if (aead) {
+			split_iov(ad_iov, plain, ad_sizes, 4, 40);
+			vial_aes_auth_update_iov(&aes, ad_iov, 2);
+			vial_aes_auth_final_iov(&aes, ad_iov + 2, 2);
+		}
+		if (vial_aes_decrypt_iov(&aes, dst_iov, 7, dst_iov, 7))
+			return 111;
+		if (memcmp(plain, result, LONG_SIZE) || (aead && vial_aes_check_tag(&aes, expected + LONG_SIZE))) {
+			printf("AES mode %d failed decrypting fragments in place\n", modes[m]);
+			return 113;
+		}
+		/* both lists must have the same length */
+		if (vial_aes_encrypt_iov(&aes, dst_iov, 6, src_iov, 9) != VIAL_AES_ERROR_LENGTH)
+			return 114;
+	}
+	/* ECB and CBC only take whole blocks in total */
+	vial_aes_init(&aes, VIAL_AES_MODE_CBC);
+	vial_aes_init_key(&aes, &aes_key);
+	vial_aes_reset(&aes, iv, sizeof(iv));
+	split_iov(src_iov, plain, src_sizes, 9, 40);
+	split_iov(dst_iov, result, dst_sizes, 7, 40);
+	if (vial_aes_encrypt_iov(&aes, dst_iov, 7, src_iov, 9) != VIAL_AES_ERROR_LENGTH)
+		return 114;
+	return 0;
+}
+
+#define JOBS 21
+/* only one job uses the AES-256 key, lanes with different key sizes do not share the backend kernel */
+#define KEY(i) &keys[(i) == 2 ? 3 : (i) % 3]
+
+/* compares the multi-buffer functions with one message at a time, with lanes using different keys and key sizes */
+static int test_jobs(enum vial_aes_backend backend)
+{
+	static const uint8_t iv[16] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88};
+	struct vial_aes_key keys[4];
+	struct vial_aes_job jobs[JOBS];
+	struct vial_aes_cbc cbc;
+	uint8_t raw_key[32], msg[JOBS * 16], expected[JOBS * 16], result[JOBS * 16];
+	size_t len;
+	for (unsigned i = 0; i < sizeof(raw_key); ++i)
+		raw_key[i] = i * 7 + 1;
+	for (unsigned i = 0; i < sizeof(msg); ++i)
+		msg[i] = i * 13 + 5;
+	for (unsigned k = 0; k < 4; ++k) {
+		raw_key[0] = k;
+		vial_aes_key_init_backend(&keys[k], backend, k == 3 ? 256 : 128, raw_key);
+	}
+	/* CMAC of lengths 0 to 20 blocks, some of them not whole */
+	for (unsigned i = 0; i < JOBS; ++i) {
+		len = i * VIAL_AES_BLOCK_SIZE - (i % 3 == 1 ? 5 : 0);
+		jobs[i] = (struct vial_aes_job) { KEY(i), msg, len, result + i * 16, NULL, 16 };
+		vial_aes_cmac_tag(KEY(i), expected + i * 16, 16, msg, len);
+	}
+	vial_aes_cmac_jobs(jobs, JOBS);
+	if (memcmp(expected, result, sizeof(result))) {
+		puts("Multi-buffer CMAC failed");
+		return 61;
+	}
+	/* CBC of adjacent messages, encrypted in place */
+	memcpy(result, msg, sizeof(msg));
+	for (unsigned i = 0, pos = 0; pos + i * 16 <= sizeof(msg); pos += i * 16, ++i) {
+		jobs[i] = (struct vial_aes_job) { KEY(i), result + pos, i * 16, result + pos, iv, 0 };
+		vial_aes_cbc_init_key(&cbc, KEY(i));
+		vial_aes_cbc_reset(&cbc, iv, sizeof(iv));
+		vial_aes_cbc_encrypt(&cbc, expected + pos, msg + pos, i * 16);
+		len = i + 1;
+	}
+	if (vial_aes_cbc_encrypt_jobs(jobs, len))
+		return 62;
+	if (memcmp(expected, result, (len - 1) * len / 2 * 16)) {
+		puts("Multi-buffer CBC encryption failed");
+		return 63;
+	}
+	return 0;
+}
+
+static int test_backend(const struct backend *backend)
+{
+	struct vial_aes_key aes_key;
 	int err;
+	if (vial_aes_key_init_backend(&aes_key, backend->backend, 128, (const uint8_t *) "0123456789ABCDEF")) {
+		printf("Skipping %s backend, not supported\n", backend->name);
+		return 0;
+	}
+	printf("Testing %s backend\n", backend->name);
 	for (const struct aes_testcase *test = aes_testcases; test->key; ++test) {
-		err = test_aes(test);
+		err = test_aes(test, backend->backend);
 		if (err) return err;
 	}
 	puts("AES encryption/decryption OK");
 	for (const struct cmac_testcase *test = cmac_testcases; test->key; ++test) {
-		err = test_cmac(test);
+		err = test_cmac(test, backend->backend);
 		if (err) return err;
 	}
 	puts("AES CMAC OK");
+	err = test_long(backend->backend);
+	if (err) return err;
+	puts("AES long messages OK");
+	err = test_gcm_key(backend->backend);
+	if (err) return err;
+	puts("AES GCM shared key OK");
+	err = test_counter_bits(backend->backend);
+	if (err) return err;
+	puts("AES CTR counter widths OK");
+	err = test_eax_lengths(backend->backend);
+	if (err) return err;
+	puts("AES EAX lengths OK");
+	err = test_seal(backend->backend);
+	if (err) return err;
+	puts("AES one-shot seal and open OK");
+	err = test_aead_jobs(backend->backend);
+	if (err) return err;
+	puts("AES batch AEAD OK");
+	err = test_iov(backend->backend);
+	if (err) return err;
+	puts("AES scatter/gather OK");
+	err = test_jobs(backend->backend);
+	if (err) return err;
+	puts("AES multi-buffer OK");
+	return 0;
+}
+
+/* more than one round of 256 chunks of 64 KiB, which the CBC decryption processes separately */
+#define PARALLEL_SIZE (257 * 65536 + 48)
+
+/* compares the parallel functions with the serial ones, decrypting in place */
+static int test_parallel(unsigned nthreads)
+{
+	static const uint8_t iv[16] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD, 0xDE, 0xCA, 0xF8, 0x88,
+		0xFF, 0xFF, 0xFF, 0xF0};
+	struct vial_aes_pool *pool = NULL;
+	struct vial_aes_key aes_key;
+	struct vial_aes_ctr ctr, ctr_par;
+	struct vial_aes_ecb ecb;
+	struct vial_aes_cbc cbc, cbc_par;
+	struct vial_aes_gcm gcm, gcm_par;
+	uint8_t *plain = malloc(PARALLEL_SIZE), *expected = malloc(PARALLEL_SIZE), *result = malloc(PARALLEL_SIZE);
+	int err = 0;
+	if (plain == NULL || expected == NULL || result == NULL) {
+		err = 81;
+		goto out;
+	}
+	if (nthreads && vial_aes_pool_create(&pool, nthreads)) {
+		puts("Skipping thread pool, not supported");
+		goto out;
+	}
+	for (size_t i = 0; i < PARALLEL_SIZE; ++i)
+		plain[i] = i * 13 + 5;
+	vial_aes_key_init(&aes_key, 128, (const uint8_t *) "0123456789ABCDEF");
+	/* a 32-bit counter which wraps around, and a message which does not start or end on a block boundary */
+	vial_aes_ctr_init_key(&ctr, &aes_key);
+	vial_aes_ctr_set_counter_bits(&ctr, 32);
+	vial_aes_ctr_reset(&ctr, iv, sizeof(iv));
+	ctr_par = ctr;
+	vial_aes_ctr_crypt(&ctr, expected, plain, 5);
+	vial_aes_ctr_crypt(&ctr, expected + 5, plain + 5, PARALLEL_SIZE - 5);
+	vial_aes_ctr_crypt(&ctr_par, result, plain, 5);
+	vial_aes_ctr_crypt_parallel(pool, &ctr_par, result + 5, plain + 5, PARALLEL_SIZE - 10);
+	vial_aes_ctr_crypt(&ctr_par, result + PARALLEL_SIZE - 5, plain + PARALLEL_SIZE - 5, 5);
+	if (memcmp(expected, result, PARALLEL_SIZE)) {
+		puts("Parallel CTR failed");
+		err = 82;
+		goto out;
+	}
+	vial_aes_ecb_init_key(&ecb, &aes_key);
+	vial_aes_ecb_encrypt(&ecb, expected, plain, PARALLEL_SIZE);
+	if (vial_aes_ecb_encrypt_parallel(pool, &ecb, result, plain, PARALLEL_SIZE) || memcmp(expected, result, PARALLEL_SIZE)
+		|| vial_aes_ecb_decrypt_parallel(pool, &ecb, result, result, PARALLEL_SIZE) || memcmp(plain, result, PARALLEL_SIZE)) {
+		puts("Parallel ECB failed");
+		err = 83;
+		goto out;
+	}
+	vial_aes_cbc_init_key(&cbc, &aes_key);
+	vial_aes_cbc_reset(&cbc, iv, sizeof(iv));
+	cbc_par = cbc;
+	vial_aes_cbc_encrypt(&cbc, expected, plain, PARALLEL_SIZE);
+	memcpy(result, expected, PARALLEL_SIZE);
+	vial_aes_cbc_decrypt_parallel(pool, &cbc_par, result, result, 48);
+	if (vial_aes_cbc_decrypt_parallel(pool, &cbc_par, result + 48, result + 48, PARALLEL_SIZE - 48)
+		|| memcmp(plain, result, PARALLEL_SIZE) || memcmp(&cbc.iv, &cbc_par.iv, sizeof(cbc.iv))) {
+		puts("Parallel CBC decryption failed");
+		err = 84;
+		goto out;
+	}
+	/* the associated data leaves a partial block, the message starts in the middle of a block */
+	vial_aes_gcm_init_key(&gcm, &aes_key);
+	vial_aes_gcm_reset(&gcm, iv, 12);
+	vial_aes_gcm_auth_final(&gcm, plain, 21);
+	gcm_par = gcm;
+	vial_aes_gcm_encrypt(&gcm, expected, plain, PARALLEL_SIZE - 16);
+	vial_aes_gcm_get_tag(&gcm, expected + PARALLEL_SIZE - 16);
+	vial_aes_gcm_encrypt(&gcm_par, result, plain, 5);
+	vial_aes_gcm_encrypt_parallel(pool, &gcm_par, result + 5, plain + 5, PARALLEL_SIZE - 26);
+	vial_aes_gcm_encrypt(&gcm_par, result + PARALLEL_SIZE - 21, plain + PARALLEL_SIZE - 21, 5);
+	vial_aes_gcm_get_tag(&gcm_par, result + PARALLEL_SIZE - 16);
+	if (memcmp(expected, result, PARALLEL_SIZE)) {
+		puts("Parallel GCM encryption failed");
+		err = 85;
+		goto out;
+	}
+	vial_aes_gcm_reset(&gcm_par, iv, 12);
+	vial_aes_gcm_auth_final(&gcm_par, plain, 21);
+	vial_aes_gcm_decrypt_parallel(pool, &gcm_par, result, result, PARALLEL_SIZE - 16);
+	if (vial_aes_gcm_check_tag(&gcm_par, expected + PARALLEL_SIZE - 16) || memcmp(plain, result, PARALLEL_SIZE - 16)) {
+		puts("Parallel GCM decryption failed");
+		err = 86;
+		goto out;
+	}
+out:
+	vial_aes_pool_destroy(pool);
+	free(plain);
+	free(expected);
+	free(result);
+	return err;
+}
+
+#define STREAM_SIZE (5 * 1024 + 300)
+
+/* checks chunked streams against chunks sealed one at a time under the key derived for the stream,
+that chunks cannot be altered or moved, and that streams with different salts share no keystream */
+static int test_stream(unsigned nthreads)
+{
+	static const uint8_t salt[VIAL_AES_STREAM_SALT_SIZE] = {0xCA, 0xFE, 0xBA, 0xBE, 0xFA, 0xCE, 0xDB, 0xAD,
+		0xDE, 0xCA, 0xF8, 0x88, 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xDC, 0xBA, 0x98};
+	static const char label[] = "VIAL stream key";
+	static const size_t lens[] = {0, 1, 1024, 1025, 4096, STREAM_SIZE};
+	static const uint8_t zero[STREAM_SIZE] = {0};
+	struct vial_aes_pool *pool = NULL;
+	struct vial_aes_key key;
+	struct vial_aes_gcm_key gcm_key;
+	struct vial_aes_eax_key eax_key;
+	struct vial_aes_stream stream, opened;
+	uint8_t plain[STREAM_SIZE], sealed[STREAM_SIZE + 16 * 16], result[STREAM_SIZE + 16 * 16], chunk[1024 + 16];
+	uint8_t nonce[12], header[VIAL_AES_STREAM_HEADER_SIZE];
+	uint8_t kdf_input[1 + sizeof(label) + VIAL_AES_STREAM_HEADER_SIZE + 2], derived[32];
+	uint64_t len;
+	int err = 0;
+	if (nthreads && vial_aes_pool_create(&pool, nthreads))
+		return 0;
+	for (unsigned i = 0; i < STREAM_SIZE; ++i)
+		plain[i] = i * 29 + 3;
+	vial_aes_key_init(&key, 256, plain);
+	if (vial_aes_stream_init(&stream, &key, VIAL_AES_MODE_CTR, 10, salt) != VIAL_AES_ERROR_CIPHER
+		|| vial_aes_stream_init(&stream, &key, VIAL_AES_MODE_GCM, 3, salt) != VIAL_AES_ERROR_LENGTH) {
+		err = 121;
+		goto out;
+	}
+	for (enum vial_aes_mode mode = VIAL_AES_MODE_EAX; mode <= VIAL_AES_MODE_GCM; ++mode) {
+		/* a master key of one block and one cut from two */
+		const unsigned keybits = mode == VIAL_AES_MODE_GCM ? 192 : 128;
+		vial_aes_key_init(&key, keybits, plain);
+		vial_aes_stream_init(&stream, &key, mode, 10, salt);
+		memcpy(header, stream.header, sizeof(header));
+		header[5] = VIAL_AES_MODE_CTR;
+		if (vial_aes_stream_init_header(&opened, &key, stream.header)
+			|| opened.mode != mode || opened.chunk_size != 1024
+			|| vial_aes_stream_init_header(&opened, &key, header) != VIAL_AES_ERROR_CIPHER
+			|| vial_aes_stream_init_header(&opened, &key, plain) != VIAL_AES_ERROR_IV) {
+			printf("Chunked stream header in mode %d not read back\n", mode);
+			err = 122;
+			goto out;
+		}
+		/* the key of the stream from the counter mode KDF of SP 800-108 with CMAC */
+		kdf_input[0] = 1;
+		memcpy(kdf_input + 1, label, sizeof(label));
+		memcpy(kdf_input + 1 + sizeof(label), stream.header, VIAL_AES_STREAM_HEADER_SIZE);
+		kdf_input[sizeof(kdf_input) - 2] = (uint8_t) (keybits >> 8);
+		kdf_input[sizeof(kdf_input) - 1] = (uint8_t) keybits;
+		vial_aes_cmac_tag(&key, derived, 16, kdf_input, sizeof(kdf_input));
+		kdf_input[0] = 2;
+		vial_aes_cmac_tag(&key, derived + 16, 16, kdf_input, sizeof(kdf_input));
+		vial_aes_gcm_key_init(&gcm_key, keybits, derived);
+		vial_aes_eax_key_init(&eax_key, keybits, derived);
+		for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i) {
+			const size_t size = (size_t) vial_aes_stream_size(&stream, lens[i]) - VIAL_AES_STREAM_HEADER_SIZE;
+			/* the last chunk is sealed separately from the others, when there are any */
+			const size_t head = lens[i] > 1024 ? (lens[i] - 1) / 1024 * 1024 : 0;
+			if ((head && vial_aes_stream_seal(pool, &stream, 0, 0, sealed, plain, head))
+				|| vial_aes_stream_seal(pool, &stream, head / 1024, 1, sealed + head / 1024 * 1040, plain + head,
+					lens[i] - head)
+				|| vial_aes_stream_message_size(&stream, size + VIAL_AES_STREAM_HEADER_SIZE, &len) || len != lens[i]) {
+				err = 123;
+				goto out;
+			}
+			/* each chunk is the message sealed with the nonce of its index */
+			for (size_t pos = 0, index = 0; pos < size; pos += 1040, ++index) {
+				const size_t n = size - pos < 1040 ? size - pos - 16 : 1024;
+				memset(nonce, 0, 10);
+				nonce[10] = (uint8_t) index;
+				nonce[11] = pos + 1040 >= size;
+				if (mode == VIAL_AES_MODE_GCM)
+					vial_aes_gcm_seal(&gcm_key, nonce, 12, stream.header, sizeof(stream.header),
+						chunk, plain + index * 1024, n);
+				else
+					vial_aes_eax_seal(&eax_key, nonce, 12, stream.header, sizeof(stream.header),
+						chunk, plain + index * 1024, n);
+				if (memcmp(chunk, sealed + pos, n + 16)) {
+					printf("Chunk %zu of a %zu byte stream in mode %d differs\n", index, lens[i], mode);
+					err = 124;
+					goto out;
+				}
+			}
+			if (vial_aes_stream_open(pool, &opened, 0, 1, result, sealed, size) || memcmp(plain, result, lens[i])) {
+				printf("Chunked stream of %zu bytes in mode %d not opened\n", lens[i], mode);
+				err = 125;
+				goto out;
+			}
+		}
+		/* seeking to a chunk in the middle, then altering one, truncating and reordering */
+		if (vial_aes_stream_open(pool, &opened, 2, 1, result, sealed + 2 * 1040, 3 * 1040 + 316)
+			|| memcmp(plain + 2048, result, 3 * 1024 + 300)
+			|| vial_aes_stream_open(pool, &opened, 1, 0, result, sealed + 1040, 2 * 1040)
+			|| memcmp(plain + 1024, result, 2048)) {
+			err = 126;
+			goto out;
+		}
+		sealed[3 * 1040 + 5] ^= 1;
+		if (vial_aes_stream_open(pool, &opened, 0, 1, result, sealed, 5 * 1040 + 316) != VIAL_AES_ERROR_MAC
+			|| memcmp(result + 3 * 1024, zero, 1024) || memcmp(result + 4 * 1024, plain + 4 * 1024, 1324)) {
+			printf("Altered chunk in mode %d not rejected on its own\n", mode);
+			err = 127;
+			goto out;
+		}
+		sealed[3 * 1040 + 5] ^= 1;
+		if (vial_aes_stream_open(pool, &opened, 0, 1, result, sealed, 5 * 1040) != VIAL_AES_ERROR_MAC
+			|| vial_aes_stream_open(pool, &opened, 1, 0, result, sealed, 1040) != VIAL_AES_ERROR_MAC
+			|| vial_aes_stream_open(pool, &opened, 0, 1, result, sealed, 5 * 1040 + 15) != VIAL_AES_ERROR_LENGTH) {
+			printf("Truncated or moved chunks in mode %d not rejected\n", mode);
+			err = 128;
+			goto out;
+		}
+		/* the stream cannot be opened under another salt */
+		memcpy(header, stream.header, sizeof(header));
+		header[VIAL_AES_STREAM_HEADER_SIZE - 1] ^= 1;
+		if (vial_aes_stream_init_header(&opened, &key, header)
+			|| vial_aes_stream_open(pool, &opened, 0, 1, result, sealed, 5 * 1040 + 316) != VIAL_AES_ERROR_MAC) {
+			printf("Chunked stream in mode %d opened with another salt\n", mode);
+			err = 129;
+			goto out;
+		}
+		/* sealing the same message of zeros twice with another salt gives two keystreams without a common block */
+		vial_aes_stream_seal(pool, &stream, 0, 1, sealed, zero, STREAM_SIZE);
+		vial_aes_stream_seal(pool, &opened, 0, 1, result, zero, STREAM_SIZE);
+		for (size_t i = 0; i + 16 <= 5 * 1040 + 316; i += 16) {
+			for (size_t j = 0; j + 16 <= 5 * 1040 + 316; j += 16) {
+				if (memcmp(sealed + i, result + j, 16) == 0) {
+					printf("Chunked streams in mode %d with different salts share keystream\n", mode);
+					err = 130;
+					goto out;
+				}
+			}
+		}
+	}
+out:
+	vial_aes_pool_destroy(pool);
+	return err;
+}
+
+int main()
+{
+	int err;
+	for (const struct backend *backend = backends; backend->name; ++backend) {
+		err = test_backend(backend);
+		if (err) return err;
+	}
+	for (unsigned nthreads = 0; nthreads <= 4; nthreads += 4) {
+		err = test_parallel(nthreads);
+		if (err) return err;
+		err = test_stream(nthreads);
+		if (err) return err;
+	}
+	puts("AES parallel modes OK");
+	puts("AES chunked streams OK");
 	return 0;
 }
@@ -0,0 +1,387 @@
+/* SPDX-License-Identifier: BSL-1.0
+Copyright (c) 2021 Pavlos Georgiou
+
+Distributed under the Boost Software License, Version 1.0.
+See accompanying file LICENSE_1_0.txt or copy at
+https://www.boost.org/LICENSE_1_0.txt
+*/
+
+/* Encrypts and decrypts files as chunked streams. Regular files are mapped into memory,
+anything else, e.g. a pipe, is read a batch of chunks at a time. Needs a POSIX system. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aes.h"
+
+/* bytes of the message sealed or opened by one call, split between the threads */
+#define BATCH_SIZE (16 * 1024 * 1024)
+
+struct options {
+	int decrypt;
+	const char *key_path;
+	enum vial_aes_mode mode;
+	unsigned chunk_bits;
+	unsigned nthreads;
+	/* range of the message to decrypt */
+	int ranged;
+	uint64_t offset, length;
+};
+
+static struct vial_aes_pool *pool;
+static struct vial_aes_key master_key;
+
+static void usage(void)
+{
+	fputs("usage: vialcrypt -e|-d -k keyfile [-m gcm|eax] [-c chunk_bits] [-t threads]\n"
+		"                 [-s offset -n length] [input [output]]\n"
+		"  -e, -d     encrypt or decrypt, the input and output default to stdin and stdout\n"
+		"  -k         file holding a raw key of 16, 24 or 32 bytes\n"
+		"  -m         mode to encrypt with, gcm by default\n"
+		"  -c         chunks of 2^chunk_bits bytes, 16 (64 KiB) by default\n"
+		"  -t         number of threads, one per CPU by default\n"
+		"  -s, -n     decrypt only `length` bytes of the message from `offset`, the input must be a file\n", stderr);
+}
+
+static int fail(const char *msg)
+{
+	fprintf(stderr, "vialcrypt: %s\n", msg);
+	return 1;
+}
+
+static int fail_errno(const char *what)
+{
+	fprintf(stderr, "vialcrypt: %s: %s\n", what, strerror(errno));
+	return 1;
+}
+
+static const char *error_message(enum vial_aes_error err)
+{
+	switch (err) {
+	case VIAL_AES_ERROR_LENGTH:
+		return "input is truncated or not a stream";
+	case VIAL_AES_ERROR_IV:
+		return "input is not a stream";
+	case VIAL_AES_ERROR_MAC:
+		return "authentication failed";
+	case VIAL_AES_ERROR_CIPHER:
+		return "unsupported mode";
+	default:
+		return "failed";
+	}
+}
+
+/* reads until `len` bytes or the end of the input, returns the number read or -1 */
+static ssize_t read_full(int fd, uint8_t *buf, size_t len)
+{
+	size_t done = 0;
+	ssize_t n;
+	while (done < len) {
+		n = read(fd, buf + done, len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
+		done += n;
+	}
+	return (ssize_t) done;
+}
+
+static int write_full(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int load_key(const char *path)
+{
+	uint8_t key[33];
+	ssize_t len;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return fail_errno(path);
+	len = read_full(fd, key, sizeof(key));
+	close(fd);
+	if (len != 16 && len != 24 && len != 32)
+		return fail("the key file must hold 16, 24 or 32 bytes");
+	vial_aes_key_init(&master_key, (unsigned) len * 8, key);
+	memset(key, 0, sizeof(key));
+	return 0;
+}
+
+static int random_salt(uint8_t *salt)
+{
+	int fd = open("/dev/urandom", O_RDONLY);
+	ssize_t len;
+	if (fd < 0)
+		return fail_errno("/dev/urandom");
+	len = read_full(fd, salt, VIAL_AES_STREAM_SALT_SIZE);
+	close(fd);
+	return len == VIAL_AES_STREAM_SALT_SIZE ? 0 : fail("could not read a random salt");
+}
+
+/* chunks sealed or opened by one call */
+static size_t batch_chunks(const struct vial_aes_stream *stream)
+{
+	return BATCH_SIZE / stream->chunk_size > 0 ? BATCH_SIZE / stream->chunk_size : 1;
+}
+
+/* seals or opens `len` bytes of whole chunks, or up to the last chunk, setting `out_len` to the bytes written */
+static enum vial_aes_error crypt_batch(const struct vial_aes_stream *stream, int decrypt, uint64_t index, int last,
+	uint8_t *dst, const uint8_t *src, size_t len, size_t *out_len)
+{
+	const size_t unit = decrypt ? stream->chunk_size + VIAL_AES_BLOCK_SIZE : stream->chunk_size;
+	/* an empty message still has its last chunk */
+	const size_t nchunks = len == 0 ? 1 : (len + unit - 1) / unit;
+	if (decrypt) {
+		*out_len = len - nchunks * VIAL_AES_BLOCK_SIZE;
+		return vial_aes_stream_open(pool, stream, index, last, dst, src, len);
+	}
+	*out_len = len + nchunks * VIAL_AES_BLOCK_SIZE;
+	return vial_aes_stream_seal(pool, stream, index, last, dst, src, len);
+}
+
+/* seals a mapped input a batch at a time */
+static int encrypt_mapped(const struct vial_aes_stream *stream, int out, const uint8_t *src, size_t len)
+{
+	const size_t nchunks = batch_chunks(stream), batch = nchunks * stream->chunk_size;
+	uint8_t *buf = malloc(nchunks * (stream->chunk_size + VIAL_AES_BLOCK_SIZE));
+	enum vial_aes_error err;
+	uint64_t index;
+	size_t n;
+	int last = 0;
+	if (buf == NULL)
+		return fail("out of memory");
+	for (index = 0; !last; index += nchunks, src += batch, len -= batch) {
+		last = len <= batch;
+		err = crypt_batch(stream, 0, index, last, buf, src, last ? len : batch, &n);
+		if (err || write_full(out, buf, n)) {
+			free(buf);
+			return err ? fail(error_message(err)) : fail_errno("write");
+		}
+	}
+	free(buf);
+	return 0;
+}
+
+/*
+ * Opens only the chunks holding the range of the message, a batch at a time, which is all of them
+ * when decrypting a whole file. The output of a batch is only written once all its chunks are verified.
+ */
+static int decrypt_mapped(const struct vial_aes_stream *stream, int out, const uint8_t *map, size_t size,
+	uint64_t offset, uint64_t length)
+{
+	const size_t nchunks = batch_chunks(stream), sealed = stream->chunk_size + VIAL_AES_BLOCK_SIZE;
+	enum vial_aes_error err;
+	uint64_t len, total, index, end, pos, stop, from, to;
+	uint8_t *buf;
+	size_t n;
+	int last;
+	if (vial_aes_stream_message_size(stream, size, &len))
+		return fail(error_message(VIAL_AES_ERROR_LENGTH));
+	total = (size - VIAL_AES_STREAM_HEADER_SIZE + sealed - 1) / sealed;
+	if (offset > len)
+		return 0;
+	if (length > len - offset)
+		length = len - offset;
+	index = offset / stream->chunk_size;
+	end = (offset + length + stream->chunk_size - 1) / stream->chunk_size;
+	/* the last chunk of an empty message, or of one ending at the offset, holds no bytes of it */
+	if (end == index && index < total)
+		end = index + 1;
+	buf = malloc(nchunks * stream->chunk_size);
+	if (buf == NULL)
+		return fail("out of memory");
+	for (; index < end; index += nchunks) {
+		stop = index + nchunks < end ? index + nchunks : end;
+		last = stop == total;
+		pos = vial_aes_stream_chunk_offset(stream, index);
+		err = crypt_batch(stream, 1, index, last, buf, map + pos,
+			(size_t) ((last ? size : vial_aes_stream_chunk_offset(stream, stop)) - pos), &n);
+		if (err) {
+			free(buf);
+			return fail(error_message(err));
+		}
+		pos = index * stream->chunk_size;
+		from = offset > pos ? offset - pos : 0;
+		to = offset + length < pos + n ? offset + length - pos : n;
+		if (write_full(out, buf + from, (size_t) (to - from))) {
+			free(buf);
+			return fail_errno("write");
+		}
+	}
+	free(buf);
+	return 0;
+}
+
+/* reads a batch and one more byte, so that the final batch is known to end with the last chunk */
+static int crypt_streamed(const struct vial_aes_stream *stream, int decrypt, int in, int out)
+{
+	const size_t unit = decrypt ? stream->chunk_size + VIAL_AES_BLOCK_SIZE : stream->chunk_size;
+	const size_t nchunks = batch_chunks(stream), batch = nchunks * unit;
+	uint8_t *src = malloc(batch + 1), *dst = malloc(nchunks * (stream->chunk_size + VIAL_AES_BLOCK_SIZE));
+	enum vial_aes_error err;
+	uint64_t index;
+	size_t have = 0, n;
+	ssize_t got;
+	int last = 0, ret = 0;
+	if (src == NULL || dst == NULL)
+		ret = fail("out of memory");
+	for (index = 0; !ret && !last; index += nchunks) {
+		got = read_full(in, src + have, batch + 1 - have);
+		if (got < 0) {
+			ret = fail_errno("read");
+			break;
+		}
+		have += got;
+		last = have <= batch;
+		err = crypt_batch(stream, decrypt, index, last, dst, src, last ? have : batch, &n);
+		if (err)
+			ret = fail(error_message(err));
+		else if (write_full(out, dst, n))
+			ret = fail_errno("write");
+		/* the extra byte starts the next batch */
+		src[0] = src[batch];
+		have = 1;
+	}
+	free(src);
+	free(dst);
+	return ret;
+}
+
+static int run(const struct options *opt, int in, int out)
+{
+	struct vial_aes_stream stream;
+	uint8_t salt[VIAL_AES_STREAM_SALT_SIZE], header[VIAL_AES_STREAM_HEADER_SIZE];
+	const uint8_t *map = NULL;
+	struct stat st;
+	size_t size = 0;
+	int ret;
+	if (fstat(in, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && (uint64_t) st.st_size <= SIZE_MAX) {
+		size = (size_t) st.st_size;
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in, 0);
+		if (map == MAP_FAILED)
+			map = NULL;
+	}
+	if (opt->ranged && map == NULL)
+		return fail("decrypting a range needs a regular file as input");
+	if (!opt->decrypt) {
+		if (random_salt(salt))
+			return 1;
+		vial_aes_stream_init(&stream, &master_key, opt->mode, opt->chunk_bits, salt);
+		if (write_full(out, stream.header, sizeof(stream.header)))
+			return fail_errno("write");
+		ret = map != NULL ? encrypt_mapped(&stream, out, map, size) : crypt_streamed(&stream, 0, in, out);
+	} else if (map != NULL) {
+		if (size < sizeof(header) || vial_aes_stream_init_header(&stream, &master_key, map))
+			ret = fail(error_message(VIAL_AES_ERROR_IV));
+		else
+			ret = decrypt_mapped(&stream, out, map, size, opt->offset, opt->length);
+	} else if (read_full(in, header, sizeof(header)) != sizeof(header)
+		|| vial_aes_stream_init_header(&stream, &master_key, header)) {
+		ret = fail(error_message(VIAL_AES_ERROR_IV));
+	} else {
+		ret = crypt_streamed(&stream, 1, in, out);
+	}
+	if (map != NULL)
+		munmap((void *) map, size);
+	return ret;
+}
+
+static int parse_number(const char *arg, uint64_t *value)
+{
+	char *end;
+	errno = 0;
+	*value = strtoull(arg, &end, 0);
+	return errno != 0 || end == arg || *end != '\0';
+}
+
+int main(int argc, char **argv)
+{
+	struct options opt = {-1, NULL, VIAL_AES_MODE_GCM, 16, 0, 0, 0, UINT64_MAX};
+	uint64_t value;
+	int c, in = STDIN_FILENO, out = STDOUT_FILENO, ret;
+	while ((c = getopt(argc, argv, "edk:m:c:t:s:n:")) != -1) {
+		switch (c) {
+		case 'e':
+		case 'd':
+			opt.decrypt = c == 'd';
+			break;
+		case 'k':
+			opt.key_path = optarg;
+			break;
+		case 'm':
+			if (strcmp(optarg, "gcm") && strcmp(optarg, "eax"))
+				return fail("the mode must be gcm or eax");
+			opt.mode = strcmp(optarg, "gcm") ? VIAL_AES_MODE_EAX : VIAL_AES_MODE_GCM;
+			break;
+		case 'c':
+			if (parse_number(optarg, &value) || value < VIAL_AES_STREAM_MIN_BITS || value > VIAL_AES_STREAM_MAX_BITS)
+				return fail("chunk_bits out of range");
+			opt.chunk_bits = (unsigned) value;
+			break;
+		case 't':
+			if (parse_number(optarg, &value) || value > 1024)
+				return fail("invalid number of threads");
+			opt.nthreads = (unsigned) value;
+			break;
+		case 's':
+			if (parse_number(optarg, &opt.offset))
+				return fail("invalid offset");
+			opt.ranged = 1;
+			break;
+		case 'n':
+			if (parse_number(optarg, &opt.length))
+				return fail("invalid length");
+			opt.ranged = 1;
+			break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (opt.decrypt < 0 || opt.key_path == NULL || argc - optind > 2 || (opt.ranged && !opt.decrypt)) {
+		usage();
+		return 2;
+	}
+	if (load_key(opt.key_path))
+		return 1;
+	if (optind < argc && strcmp(argv[optind], "-")) {
+		in = open(argv[optind], O_RDONLY);
+		if (in < 0)
+			return fail_errno(argv[optind]);
+	}
+	if (optind + 1 < argc && strcmp(argv[optind + 1], "-")) {
+		/* private to the user, as decrypting writes the plaintext */
+		out = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (out < 0)
+			return fail_errno(argv[optind + 1]);
+	}
+	/* without threads in the build the calling thread does all the work */
+	if (opt.nthreads != 1 && vial_aes_pool_create(&pool, opt.nthreads))
+		pool = NULL;
+	ret = run(&opt, in, out);
+	vial_aes_pool_destroy(pool);
+	if (out != STDOUT_FILENO && close(out))
+		ret = fail_errno("close");
+	return ret;
+}